@@ -0,0 +1,118 @@
+/** Interposes malloc/free and pthread mutex functions to detect calls made while auditing.
+
+Only supports glibc, which exports the `__libc_*` allocator entry points.
+operator new/delete and std::mutex are covered because libstdc++ implements them with these functions.
+*/
+#include "audit.hpp"
+#include <cstddef>
+#include <dlfcn.h>
+#include <pthread.h>
+
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+
+namespace audit {
+
+
+static thread_local bool auditing = false;
+static thread_local Violations violations;
+
+
+void begin() {
+	violations = Violations();
+	auditing = true;
+}
+
+
+Violations end() {
+	auditing = false;
+	return violations;
+}
+
+
+} // namespace audit
+
+
+extern "C" {
+
+
+void* malloc(size_t size) {
+	if (audit::auditing)
+		audit::violations.allocations++;
+	return __libc_malloc(size);
+}
+
+
+void* calloc(size_t n, size_t size) {
+	if (audit::auditing)
+		audit::violations.allocations++;
+	return __libc_calloc(n, size);
+}
+
+
+void* realloc(void* ptr, size_t size) {
+	if (audit::auditing)
+		audit::violations.allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+
+void* memalign(size_t alignment, size_t size) {
+	if (audit::auditing)
+		audit::violations.allocations++;
+	return __libc_memalign(alignment, size);
+}
+
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	return memalign(alignment, size);
+}
+
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+	void* p = memalign(alignment, size);
+	if (!p)
+		return 12; // ENOMEM
+	*ptr = p;
+	return 0;
+}
+
+
+void free(void* ptr) {
+	if (audit::auditing && ptr)
+		audit::violations.frees++;
+	__libc_free(ptr);
+}
+
+
+typedef int (*MutexFunction)(pthread_mutex_t*);
+
+static MutexFunction getNextMutexFunction(const char* name) {
+	return (MutexFunction) dlsym(RTLD_NEXT, name);
+}
+
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	static MutexFunction next = getNextMutexFunction("pthread_mutex_lock");
+	if (audit::auditing)
+		audit::violations.locks++;
+	return next(mutex);
+}
+
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) {
+	static MutexFunction next = getNextMutexFunction("pthread_mutex_trylock");
+	if (audit::auditing)
+		audit::violations.locks++;
+	return next(mutex);
+}
+
+
+} // extern "C"
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+
+/** Real-time-safety audit.
+
+Linking audit.cpp into an executable interposes the C allocator and pthread mutex functions.
+Calls made on a thread between begin() and end() are counted as violations.
+*/
+namespace audit {
+
+
+struct Violations {
+	int64_t allocations = 0;
+	int64_t frees = 0;
+	int64_t locks = 0;
+
+	bool any() const {
+		return allocations || frees || locks;
+	}
+};
+
+
+/** Starts counting violations on the calling thread. */
+void begin();
+/** Stops counting and returns the violations since begin(). */
+Violations end();
+
+
+} // namespace audit
@@ -0,0 +1,664 @@
+/** Headless DSP benchmark of every module registered by the plugin.
+
+Creates each Model without a ModuleWidget, connects all ports with synthetic signals, and times Module::process() at several polyphony levels.
+Results are printed to stdout as JSON.
+
+When built with AUDIT defined, heap allocations, frees, and mutex locks made inside process() are also reported, and the exit code is nonzero if any module made one.
+
+Other suites benchmark individual DSP components and are selected with -s.
+The aliasing suite measures the output quality of the oscillators instead and prints CSV.
+
+Usage: bench [-s suite] [-f frames] [-r sampleRate] [slug ...]
+Suites: modules (default), minblep, simd, wavetable, interpolate, aliasing
+*/
+#include "../src/plugin.hpp"
+#include "../src/MinBlep.hpp"
+#include "../src/VoltageControlledOscillator.hpp"
+#include "../src/LadderFilter.hpp"
+#include "../src/Wavetable.hpp"
+#if defined AUDIT
+	#include "audit.hpp"
+#endif
+
+
+void init(plugin::Plugin* p);
+
+
+static const int SIGNAL_LEN = 4096;
+static float signalTable[SIGNAL_LEN];
+
+static const int CHANNELS[] = {1, 4, 8, 16};
+
+
+struct Options {
+	std::string suite = "modules";
+	int64_t frames = 1 << 16;
+	int64_t warmupFrames = 1 << 12;
+	float sampleRate = 48000.f;
+	std::vector<std::string> slugs;
+};
+
+
+/** Sets every input to a sine with a different frequency per port and phase per channel.
+A full-scale sine crosses every gate, trigger, and clock threshold used by the plugin.
+*/
+static void setInputs(engine::Module* module, int64_t frame) {
+	for (size_t i = 0; i < module->inputs.size(); i++) {
+		engine::Input& input = module->inputs[i];
+		for (int c = 0; c < input.channels; c++) {
+			input.setVoltage(signalTable[(frame * (i + 1) + c * (SIGNAL_LEN / 16)) % SIGNAL_LEN], c);
+		}
+	}
+}
+
+
+static void connectPorts(engine::Module* module, int channels) {
+	for (engine::Input& input : module->inputs) {
+		input.channels = channels;
+	}
+	for (engine::Output& output : module->outputs) {
+		output.channels = channels;
+	}
+}
+
+
+struct Result {
+	/** Mean duration of one Module::process() call in seconds */
+	double duration = 0.0;
+#if defined AUDIT
+	audit::Violations violations;
+#endif
+};
+
+
+static Result benchModule(plugin::Model* model, int channels, const Options& options) {
+	Result result;
+	engine::Module* module = model->createModule();
+	DEFER({delete module;});
+
+	engine::Module::SampleRateChangeEvent e;
+	e.sampleRate = options.sampleRate;
+	e.sampleTime = 1.f / options.sampleRate;
+	module->onSampleRateChange(e);
+	connectPorts(module, channels);
+
+	engine::Module::ProcessArgs args;
+	args.sampleRate = options.sampleRate;
+	args.sampleTime = 1.f / options.sampleRate;
+	args.frame = 0;
+
+	for (; args.frame < options.warmupFrames; args.frame++) {
+		setInputs(module, args.frame);
+		module->process(args);
+	}
+
+	double startTime = system::getTime();
+#if defined AUDIT
+	audit::begin();
+#endif
+	for (int64_t i = 0; i < options.frames; i++, args.frame++) {
+		setInputs(module, args.frame);
+		module->process(args);
+	}
+#if defined AUDIT
+	result.violations = audit::end();
+#endif
+	double endTime = system::getTime();
+	result.duration = (endTime - startTime) / options.frames;
+	return result;
+}
+
+
+static json_t* benchModules(plugin::Plugin* plugin, const Options& options, bool* failed) {
+	json_t* modulesJ = json_array();
+	for (plugin::Model* model : plugin->models) {
+		if (!options.slugs.empty() && std::find(options.slugs.begin(), options.slugs.end(), model->slug) == options.slugs.end())
+			continue;
+
+		for (int channels : CHANNELS) {
+			Result result = benchModule(model, channels, options);
+
+			json_t* moduleJ = json_object();
+			json_object_set_new(moduleJ, "slug", json_string(model->slug.c_str()));
+			json_object_set_new(moduleJ, "channels", json_integer(channels));
+			json_object_set_new(moduleJ, "nsPerSample", json_real(result.duration * 1e9));
+			json_object_set_new(moduleJ, "nsPerChannelSample", json_real(result.duration * 1e9 / channels));
+#if defined AUDIT
+			json_object_set_new(moduleJ, "allocations", json_integer(result.violations.allocations));
+			json_object_set_new(moduleJ, "frees", json_integer(result.violations.frees));
+			json_object_set_new(moduleJ, "locks", json_integer(result.violations.locks));
+			if (result.violations.any()) {
+				std::fprintf(stderr, "%s (%d channels): %lld allocations, %lld frees, %lld locks in process()\n", model->slug.c_str(), channels, (long long) result.violations.allocations, (long long) result.violations.frees, (long long) result.violations.locks);
+				*failed = true;
+			}
+#endif
+			json_array_append_new(modulesJ, moduleJ);
+		}
+	}
+	return modulesJ;
+}
+
+
+/** Compares inserting a discontinuity in 1 to 4 lanes with a per-lane dsp::MinBlepGenerator loop and with BatchMinBlepGenerator. */
+static json_t* benchMinBlep(const Options& options) {
+	typedef simd::float_4 T;
+	json_t* resultsJ = json_array();
+	float sum = 0.f;
+
+	for (int lanes = 1; lanes <= 4; lanes++) {
+		int mask = (1 << lanes) - 1;
+		T x = simd::movemaskInverse<T>(mask) & T(2.f);
+
+		dsp::MinBlepGenerator<16, 16, T> scalarMinBlep;
+		double startTime = system::getTime();
+		for (int64_t frame = 0; frame < options.frames; frame++) {
+			T p = -signalTable[frame % SIGNAL_LEN] * signalTable[frame % SIGNAL_LEN] / 25.f;
+			for (int i = 0; i < 4; i++) {
+				if (mask & (1 << i))
+					scalarMinBlep.insertDiscontinuity(p[i], simd::movemaskInverse<T>(1 << i) & x);
+			}
+			sum += scalarMinBlep.process()[0];
+		}
+		double scalarDuration = (system::getTime() - startTime) / options.frames;
+
+		BatchMinBlepGenerator<16, 16, T> batchMinBlep;
+		startTime = system::getTime();
+		for (int64_t frame = 0; frame < options.frames; frame++) {
+			T p = -signalTable[frame % SIGNAL_LEN] * signalTable[frame % SIGNAL_LEN] / 25.f;
+			batchMinBlep.insertDiscontinuity(p, x);
+			sum += batchMinBlep.process()[0];
+		}
+		double batchDuration = (system::getTime() - startTime) / options.frames;
+
+		json_t* resultJ = json_object();
+		json_object_set_new(resultJ, "lanes", json_integer(lanes));
+		json_object_set_new(resultJ, "scalarNs", json_real(scalarDuration * 1e9));
+		json_object_set_new(resultJ, "batchNs", json_real(batchDuration * 1e9));
+		json_object_set_new(resultJ, "speedup", json_real(scalarDuration / batchDuration));
+		json_array_append_new(resultsJ, resultJ);
+	}
+
+	// Use the output so the loops are not optimized away
+	if (!std::isfinite(sum))
+		std::fprintf(stderr, "Non-finite minBLEP output\n");
+	return resultsJ;
+}
+
+
+/** Returns a slowly varying control value around 0.5 for bank inputs. */
+static float signalInput(int64_t frame, int c, int port) {
+	return 0.5f + 0.1f * signalTable[(frame * (port + 1) + c * (SIGNAL_LEN / 16)) % SIGNAL_LEN];
+}
+
+
+static double benchOscillatorBank(OscillatorBank* bank, const Options& options, float* out) {
+	bank->analog = true;
+	double startTime = system::getTime();
+	for (int64_t frame = 0; frame < options.frames; frame++) {
+		for (int c = 0; c < 16; c++) {
+			bank->freq[c] = dsp::FREQ_C4 * (1.f + signalInput(frame, c, 0));
+			bank->pulseWidth[c] = signalInput(frame, c, 1);
+		}
+		bank->process(16, 1.f / options.sampleRate);
+		for (int c = 0; c < 16; c++) {
+			out[frame % SIGNAL_LEN] += bank->sin[c] + bank->tri[c] + bank->saw[c] + bank->sqr[c];
+		}
+	}
+	return (system::getTime() - startTime) / options.frames;
+}
+
+
+static double benchLadderFilterBank(LadderFilterBank* bank, const Options& options, float* out) {
+	double startTime = system::getTime();
+	for (int64_t frame = 0; frame < options.frames; frame++) {
+		for (int c = 0; c < 16; c++) {
+			bank->input[c] = signalTable[(frame * (c + 1)) % SIGNAL_LEN];
+			bank->cutoff[c] = 20000.f * signalInput(frame, c, 0);
+			bank->resonance[c] = 4.f * signalInput(frame, c, 1);
+		}
+		bank->process(16, 1.f / options.sampleRate);
+		for (int c = 0; c < 16; c++) {
+			out[frame % SIGNAL_LEN] += bank->lowpass[c] + bank->highpass[c];
+		}
+	}
+	return (system::getTime() - startTime) / options.frames;
+}
+
+
+static json_t* simdResultJson(const char* name, double sseDuration, double avx2Duration, const float* sseOut, const float* avx2Out) {
+	json_t* resultJ = json_object();
+	json_object_set_new(resultJ, "name", json_string(name));
+	json_object_set_new(resultJ, "sseNs", json_real(sseDuration * 1e9));
+	if (avx2Out) {
+		float maxError = 0.f;
+		for (int i = 0; i < SIGNAL_LEN; i++) {
+			maxError = std::max(maxError, std::fabs(sseOut[i] - avx2Out[i]));
+		}
+		json_object_set_new(resultJ, "avx2Ns", json_real(avx2Duration * 1e9));
+		json_object_set_new(resultJ, "speedup", json_real(sseDuration / avx2Duration));
+		json_object_set_new(resultJ, "maxError", json_real(maxError));
+	}
+	return resultJ;
+}
+
+
+/** Compares the float_4 and float_8 DSP cores on the same inputs with 16 channels.
+The AVX2 fields are omitted if the CPU doesn't support AVX2.
+*/
+static json_t* benchSimd(const Options& options) {
+	json_t* resultsJ = json_array();
+	std::vector<float> sseOut(SIGNAL_LEN);
+	std::vector<float> avx2Out(SIGNAL_LEN);
+	bool avx2 = false;
+#if defined AVX2_CORES
+	avx2 = hasAvx2();
+#endif
+
+	{
+		std::unique_ptr<OscillatorBank> sseBank(newOscillatorBank<simd::float_4>(1, 0));
+		double sseDuration = benchOscillatorBank(sseBank.get(), options, sseOut.data());
+		double avx2Duration = 0.0;
+#if defined AVX2_CORES
+		if (avx2) {
+			std::unique_ptr<OscillatorBank> avx2Bank(createOscillatorBankAvx2(1, 0));
+			avx2Duration = benchOscillatorBank(avx2Bank.get(), options, avx2Out.data());
+		}
+#endif
+		json_array_append_new(resultsJ, simdResultJson("VoltageControlledOscillator", sseDuration, avx2Duration, sseOut.data(), avx2 ? avx2Out.data() : NULL));
+	}
+
+	std::fill(sseOut.begin(), sseOut.end(), 0.f);
+	std::fill(avx2Out.begin(), avx2Out.end(), 0.f);
+	{
+		std::unique_ptr<LadderFilterBank> sseBank(new TLadderFilterBank<simd::float_4>);
+		double sseDuration = benchLadderFilterBank(sseBank.get(), options, sseOut.data());
+		double avx2Duration = 0.0;
+#if defined AVX2_CORES
+		if (avx2) {
+			std::unique_ptr<LadderFilterBank> avx2Bank(createLadderFilterBankAvx2());
+			avx2Duration = benchLadderFilterBank(avx2Bank.get(), options, avx2Out.data());
+		}
+#endif
+		json_array_append_new(resultsJ, simdResultJson("LadderFilter", sseDuration, avx2Duration, sseOut.data(), avx2 ? avx2Out.data() : NULL));
+	}
+	return resultsJ;
+}
+
+
+/** Compares WavetableData::getWave() one channel at a time with 4 channels at a time, on the default wavetable with WTVCO's default quality, for each kernel. */
+static json_t* benchWavetable(const Options& options) {
+	typedef simd::float_4 T;
+	Wavetable wavetable;
+	wavetable.setQuality(8);
+	wavetable.reset();
+	Wavetable::Reader reader(wavetable, Wavetable::AUDIO_READER);
+	const WavetableData& data = *reader.data;
+	float maxPos = data.getWaveCount() - 1;
+
+	json_t* resultsJ = json_array();
+	for (int k = 0; k < WavetableData::NUM_KERNELS; k++) {
+		WavetableData::Kernel kernel = (WavetableData::Kernel) k;
+		for (int channels : CHANNELS) {
+			float maxError = 0.f;
+			double scalarDuration = 0.0;
+			double simdDuration = 0.0;
+
+			// Time blocks of frames so reading the clock doesn't dominate
+			const int blockLen = 256;
+			std::vector<float> phase(blockLen * 16);
+			std::vector<float> pos(blockLen * 16);
+			std::vector<float> octave(blockLen * 16);
+			std::vector<float> scalarOut(blockLen * 16);
+			std::vector<float> simdOut(blockLen * 16);
+			int64_t frame = 0;
+			for (; frame < options.frames; frame += blockLen) {
+				// Different phase, position, and octave for each channel
+				for (int i = 0; i < blockLen; i++) {
+					for (int c = 0; c < 16; c++) {
+						float x = signalTable[((frame + i) * (c + 1)) % SIGNAL_LEN] / 10.f + 0.5f;
+						phase[i * 16 + c] = std::min(x, 0.999f);
+						pos[i * 16 + c] = x * maxPos;
+						octave[i * 16 + c] = x * data.octaves;
+					}
+				}
+
+				double startTime = system::getTime();
+				for (int i = 0; i < blockLen; i++) {
+					for (int c = 0; c < channels; c++) {
+						scalarOut[i * 16 + c] = data.getWave(phase[i * 16 + c], pos[i * 16 + c], octave[i * 16 + c], kernel);
+					}
+				}
+				double midTime = system::getTime();
+				for (int i = 0; i < blockLen; i++) {
+					for (int c = 0; c < channels; c += 4) {
+						int j = i * 16 + c;
+						data.getWave(T::load(&phase[j]), T::load(&pos[j]), T::load(&octave[j]), kernel).store(&simdOut[j]);
+					}
+				}
+				double endTime = system::getTime();
+				scalarDuration += midTime - startTime;
+				simdDuration += endTime - midTime;
+
+				for (int i = 0; i < blockLen; i++) {
+					for (int c = 0; c < channels; c++) {
+						maxError = std::max(maxError, std::fabs(simdOut[i * 16 + c] - scalarOut[i * 16 + c]));
+					}
+				}
+			}
+			scalarDuration /= frame;
+			simdDuration /= frame;
+
+			json_t* resultJ = json_object();
+			json_object_set_new(resultJ, "kernel", json_string(kernel == WavetableData::CUBIC_KERNEL ? "cubic" : "linear"));
+			json_object_set_new(resultJ, "channels", json_integer(channels));
+			json_object_set_new(resultJ, "scalarNs", json_real(scalarDuration * 1e9));
+			json_object_set_new(resultJ, "simdNs", json_real(simdDuration * 1e9));
+			json_object_set_new(resultJ, "speedup", json_real(scalarDuration / simdDuration));
+			json_object_set_new(resultJ, "maxError", json_real(maxError));
+			json_array_append_new(resultsJ, resultJ);
+		}
+	}
+	return resultsJ;
+}
+
+
+static const int INTERPOLATE_WAVES = 64;
+
+
+/** Times WavetableData::interpolate() with WTVCO's quality on 64 waves of each length, using getWavetableThreadCount() threads.
+The first call at each length creates the FFT plans and grows the scratch memory, and later calls reuse them and the pool threads.
+*/
+static json_t* benchInterpolate(const Options& options) {
+	// Without a user, the pool would run interpolate() on this thread only.
+	WavetableThreadPool::get().addUser();
+	DEFER({WavetableThreadPool::get().removeUser();});
+	json_t* resultsJ = json_array();
+	for (size_t waveLen = 16; waveLen <= 16384; waveLen *= 2) {
+		WavetableData data;
+		data.waveLen = waveLen;
+		data.quality = 8;
+		data.samples.resize(waveLen * INTERPOLATE_WAVES);
+		for (size_t i = 0; i < data.samples.size(); i++) {
+			data.samples.data()[i] = signalTable[(i * 7) % SIGNAL_LEN] / 5.f;
+		}
+
+		double startTime = system::getTime();
+		data.interpolate();
+		double firstDuration = system::getTime() - startTime;
+
+		// Repeat until about as many points as the other suites' frames are processed
+		int64_t iterations = std::max<int64_t>(1, options.frames * 16 / data.samples.size());
+		startTime = system::getTime();
+		for (int64_t i = 0; i < iterations; i++) {
+			data.interpolate();
+		}
+		double duration = (system::getTime() - startTime) / iterations;
+
+		json_t* resultJ = json_object();
+		json_object_set_new(resultJ, "waveLen", json_integer(waveLen));
+		json_object_set_new(resultJ, "threads", json_integer(getWavetableThreadCount()));
+		json_object_set_new(resultJ, "firstMs", json_real(firstDuration * 1e3));
+		json_object_set_new(resultJ, "ms", json_real(duration * 1e3));
+		json_object_set_new(resultJ, "nsPerPoint", json_real(duration * 1e9 / data.samples.size()));
+		json_array_append_new(resultsJ, resultJ);
+	}
+	return resultsJ;
+}
+
+
+static const float ALIASING_SAMPLE_RATES[] = {44100.f, 48000.f, 96000.f};
+/** The frequency sweep starts at A1 and rises in third-octave steps until ALIASING_MAX_FREQ times the sample rate.
+Each step is measured as a steady tone, since the signal-to-alias ratio needs a spectrum that doesn't move during the FFT.
+*/
+static const float ALIASING_MIN_FREQ = 55.f;
+static const int ALIASING_STEPS_PER_OCTAVE = 3;
+static const float ALIASING_MAX_FREQ = 0.45f;
+static const int ALIASING_LEN = 1 << 14;
+/** Half width of the Blackman-Harris main lobe in bins */
+static const int ALIASING_LOBE = 4;
+
+
+/** Sweep rendered by a module at one parameter setting, measured at every output. */
+struct AliasingCase {
+	std::string slug;
+	/** Name in the CSV, followed by the output name if the module has several */
+	std::string name;
+	std::string paramName;
+	float paramValue;
+};
+
+
+static const AliasingCase ALIASING_CASES[] = {
+	{"VCO", "VCO", "", 0.f},
+	{"WTVCO", "WTVCO sine", "Wavetable position", 0.f},
+	{"WTVCO", "WTVCO triangle", "Wavetable position", 1 / 3.f},
+	{"WTVCO", "WTVCO sawtooth", "Wavetable position", 2 / 3.f},
+	{"WTVCO", "WTVCO square", "Wavetable position", 1.f},
+};
+
+
+/** Returns the ratio in dB of the power at harmonics of `freq` to the power at all other frequencies except DC.
+`x` is windowed in place.
+*/
+static float signalToAliasRatio(float* x, float sampleRate, float freq) {
+	dsp::blackmanHarrisWindow(x, ALIASING_LEN);
+	dsp::RealFFT fft(ALIASING_LEN);
+	std::vector<float> spectrum(ALIASING_LEN);
+	fft.rfft(x, spectrum.data());
+
+	double signalPower = 0.0;
+	double aliasPower = 0.0;
+	float harmonicBins = freq / sampleRate * ALIASING_LEN;
+	// The output is ordered as (real, imaginary) pairs, except that bin 0 holds the DC and Nyquist real parts.
+	for (int i = ALIASING_LOBE + 1; i < ALIASING_LEN / 2; i++) {
+		double power = std::pow(spectrum[2 * i], 2) + std::pow(spectrum[2 * i + 1], 2);
+		float harmonic = std::round(i / harmonicBins) * harmonicBins;
+		if (harmonic > 0.f && std::fabs(i - harmonic) <= ALIASING_LOBE)
+			signalPower += power;
+		else
+			aliasPower += power;
+	}
+	return 10 * std::log10(signalPower / std::max(aliasPower, 1e-30));
+}
+
+
+static int findPort(const std::vector<engine::PortInfo*>& infos, const std::string& name) {
+	for (size_t i = 0; i < infos.size(); i++) {
+		if (infos[i]->name == name)
+			return i;
+	}
+	return -1;
+}
+
+
+/** Renders one tone with Module::process() and prints a CSV row for each output. */
+static void benchAliasingCase(plugin::Model* model, const AliasingCase& aliasingCase, float sampleRate, float freq) {
+	engine::Module* module = model->createModule();
+	DEFER({delete module;});
+
+	engine::Module::SampleRateChangeEvent e;
+	e.sampleRate = sampleRate;
+	e.sampleTime = 1.f / sampleRate;
+	module->onSampleRateChange(e);
+
+	for (engine::ParamQuantity* pq : module->paramQuantities) {
+		if (pq->name == aliasingCase.paramName)
+			pq->setValue(aliasingCase.paramValue);
+	}
+	int pitchInput = findPort(module->inputInfos, "1V/octave pitch");
+	if (pitchInput < 0)
+		return;
+	module->inputs[pitchInput].channels = 1;
+	module->inputs[pitchInput].setVoltage(std::log2(freq / dsp::FREQ_C4));
+	for (engine::Output& output : module->outputs) {
+		output.channels = 1;
+	}
+
+	engine::Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	args.frame = 0;
+
+	// Let filters and minBLEP buffers settle
+	for (; args.frame < (int64_t) sampleRate / 4; args.frame++) {
+		module->process(args);
+	}
+
+	int outputs = module->outputs.size();
+	std::vector<float> buffers(outputs * ALIASING_LEN);
+	double startTime = system::getTime();
+	for (int i = 0; i < ALIASING_LEN; i++, args.frame++) {
+		module->process(args);
+		for (int o = 0; o < outputs; o++) {
+			buffers[o * ALIASING_LEN + i] = module->outputs[o].getVoltage() / 5.f;
+		}
+	}
+	double duration = (system::getTime() - startTime) / ALIASING_LEN;
+
+	for (int o = 0; o < outputs; o++) {
+		float* x = &buffers[o * ALIASING_LEN];
+		float dc = 0.f;
+		for (int i = 0; i < ALIASING_LEN; i++) {
+			dc += x[i];
+		}
+		dc /= ALIASING_LEN;
+		float sar = signalToAliasRatio(x, sampleRate, freq);
+
+		std::string name = aliasingCase.name;
+		if (outputs > 1)
+			name += " " + string::lowercase(module->outputInfos[o]->name);
+		std::printf("%s,%g,%g,%.2f,%.6f,,%.2f\n", name.c_str(), sampleRate, freq, sar, dc, duration * 1e9);
+	}
+}
+
+
+/** Prints the maximum error of `f` against `reference` on [0, 1] and the time per evaluation. */
+template <typename F, typename R>
+static void benchApproximation(const char* name, F f, R reference) {
+	typedef simd::float_4 T;
+	const int len = 1 << 16;
+	float maxError = 0.f;
+	for (int i = 0; i <= len; i++) {
+		float x = float(i) / len;
+		maxError = std::max(maxError, std::fabs(f(T(x))[0] - reference(x)));
+	}
+
+	T sum = 0.f;
+	double startTime = system::getTime();
+	for (int i = 0; i < len; i += 4) {
+		sum += f(T(i, i + 1, i + 2, i + 3) / len);
+	}
+	double duration = (system::getTime() - startTime) / len;
+	// Use the output so the loop is not optimized away
+	if (!std::isfinite(sum[0]))
+		std::fprintf(stderr, "Non-finite %s output\n", name);
+
+	std::printf("%s,,,,,%g,%.3f\n", name, maxError, duration * 1e9);
+}
+
+
+/** Prints CSV with the signal-to-alias ratio and DC offset of VCO and WTVCO over a frequency sweep at several sample rates, and the error of the oscillators' waveshape approximations. */
+static void benchAliasing(plugin::Plugin* plugin, const Options& options) {
+	std::printf("name,sampleRate,frequency,sarDb,dc,maxError,nsPerSample\n");
+
+	for (const AliasingCase& aliasingCase : ALIASING_CASES) {
+		if (!options.slugs.empty() && std::find(options.slugs.begin(), options.slugs.end(), aliasingCase.slug) == options.slugs.end())
+			continue;
+		plugin::Model* model = plugin->getModel(aliasingCase.slug);
+		if (!model)
+			continue;
+		for (float sampleRate : ALIASING_SAMPLE_RATES) {
+			for (int step = 0;; step++) {
+				float freq = ALIASING_MIN_FREQ * std::pow(2.f, float(step) / ALIASING_STEPS_PER_OCTAVE);
+				if (freq >= ALIASING_MAX_FREQ * sampleRate)
+					break;
+				benchAliasingCase(model, aliasingCase, sampleRate, freq);
+			}
+		}
+	}
+
+	benchApproximation("sin2pi_pade_05_5_4",
+		[](simd::float_4 x) {return sin2pi_pade_05_5_4(x);},
+		[](float x) {return std::sin(2 * float(M_PI) * x);}
+	);
+	// expCurve() approximates an RC charging curve from 1 to -1.
+	// k = 2.485 minimizes the maximum error.
+	benchApproximation("expCurve",
+		[](simd::float_4 x) {return expCurve(x);},
+		[](float x) {
+			const float k = 2.485f;
+			return 1.f - 2.f * (1.f - std::exp(-k * x)) / (1.f - std::exp(-k));
+		}
+	);
+}
+
+
+static Options parseOptions(int argc, char* argv[]) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-s" && i + 1 < argc) {
+			options.suite = argv[++i];
+		}
+		else if (arg == "-f" && i + 1 < argc) {
+			options.frames = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "-r" && i + 1 < argc) {
+			options.sampleRate = std::max(1.f, (float) std::atof(argv[++i]));
+		}
+		else {
+			options.slugs.push_back(arg);
+		}
+	}
+	return options;
+}
+
+
+int main(int argc, char* argv[]) {
+	Options options = parseOptions(argc, argv);
+
+	random::init();
+	for (int i = 0; i < SIGNAL_LEN; i++) {
+		signalTable[i] = 5.f * std::sin(2 * float(M_PI) * i / SIGNAL_LEN);
+	}
+
+	// Register models the same way Rack does when loading the plugin
+	plugin::Plugin* plugin = new plugin::Plugin;
+	plugin->slug = "Fundamental";
+	init(plugin);
+
+	if (options.suite == "aliasing") {
+		benchAliasing(plugin, options);
+		return 0;
+	}
+
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "sampleRate", json_real(options.sampleRate));
+	json_object_set_new(rootJ, "frames", json_integer(options.frames));
+	bool failed = false;
+	if (options.suite == "modules") {
+		json_object_set_new(rootJ, "modules", benchModules(plugin, options, &failed));
+	}
+	else if (options.suite == "minblep") {
+		json_object_set_new(rootJ, "minblep", benchMinBlep(options));
+	}
+	else if (options.suite == "simd") {
+		json_object_set_new(rootJ, "simd", benchSimd(options));
+	}
+	else if (options.suite == "wavetable") {
+		json_object_set_new(rootJ, "wavetable", benchWavetable(options));
+	}
+	else if (options.suite == "interpolate") {
+		json_object_set_new(rootJ, "interpolate", benchInterpolate(options));
+	}
+	else {
+		std::fprintf(stderr, "Unknown suite %s\n", options.suite.c_str());
+		return 1;
+	}
+
+	char* s = json_dumps(rootJ, JSON_INDENT(2) | JSON_REAL_PRECISION(6));
+	std::printf("%s\n", s);
+	std::free(s);
+	json_decref(rootJ);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <rack.hpp>
+
+
+/** Base of classes allocated with new whose subclasses may contain SIMD vectors wider than the alignment of operator new before C++17, such as float_8.
+Aligns them to 32 bytes.
+*/
+struct Aligned32 {
+	void* operator new(size_t size) {
+		void* p = std::malloc(size + 32);
+		if (!p)
+			throw std::bad_alloc();
+		void* aligned = (void*) (((uintptr_t) p + 32) & ~uintptr_t(31));
+		((void**) aligned)[-1] = p;
+		return aligned;
+	}
+	void operator delete(void* aligned) {
+		if (aligned)
+			std::free(((void**) aligned)[-1]);
+	}
+};
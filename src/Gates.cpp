@@ -37,6 +37,54 @@ struct Gates : Module {
 	dsp::BooleanTrigger resetParamTrigger;
 	dsp::ClockDivider lightDivider;
 
+	/** Fixed-capacity history of gate state changes, ordered by time.
+	Oldest events are overwritten when full, so pushing never allocates.
+	*/
+	struct StateEvents {
+		static const size_t CAPACITY = 1 << 10;
+		struct Event {
+			double time;
+			bool state;
+		};
+		Event events[CAPACITY];
+		size_t start = 0;
+		size_t size = 0;
+
+		void clear() {
+			start = 0;
+			size = 0;
+		}
+
+		/** `time` must not be earlier than the last pushed event. */
+		void push(double time, bool state) {
+			if (size == CAPACITY) {
+				start = (start + 1) % CAPACITY;
+				size--;
+			}
+			events[(start + size) % CAPACITY] = {time, state};
+			size++;
+		}
+
+		/** Returns the state of the latest event less than or equal to `time`.
+		If not found, returns false.
+		*/
+		bool getState(double time) const {
+			// Binary search for the first event after `time`
+			size_t low = 0;
+			size_t high = size;
+			while (low < high) {
+				size_t mid = (low + high) / 2;
+				if (events[(start + mid) % CAPACITY].time <= time)
+					low = mid + 1;
+				else
+					high = mid;
+			}
+			if (low == 0)
+				return false;
+			return events[(start + low - 1) % CAPACITY].state;
+		}
+	};
+
 	struct Engine {
 		bool state = false;
 		dsp::SchmittTrigger resetTrigger;
@@ -44,8 +92,7 @@ struct Gates : Module {
 		dsp::PulseGenerator fallPulse;
 		bool flop = false;
 		float gateTime = INFINITY;
-		// TODO Change this to a circular buffer with binary search, to avoid allocations when events are pushed.
-		std::map<double, bool> stateEvents;
+		StateEvents stateEvents;
 	};
 	Engine engines[16];
 
@@ -150,24 +197,15 @@ struct Gates : Module {
 
 			// Gate delay output
 			if (outputs[DELAY_OUTPUT].isConnected()) {
-				bool delayGate = false;
 				// Timestamp of past gate
 				double delayTime = time - gateLength;
 				// Find event less than or equal to delayTime.
 				// If not found, gate will be off.
-				auto eventIt = e.stateEvents.upper_bound(delayTime);
-				if (eventIt != e.stateEvents.begin()) {
-					eventIt--;
-					delayGate = eventIt->second;
-				}
+				bool delayGate = e.stateEvents.getState(delayTime);
 
 				if (newState) {
-					// Keep buffer a reasonable size
-					if (e.stateEvents.size() >= (1 << 10) - 1) {
-						e.stateEvents.erase(e.stateEvents.begin());
-					}
 					// Insert current state at current time
-					e.stateEvents[time] = e.state;
+					e.stateEvents.push(time, e.state);
 				}
 
 				outputs[DELAY_OUTPUT].setVoltage(delayGate ? 10.f : 0.f, c);
@@ -0,0 +1,110 @@
+#pragma once
+#include <rack.hpp>
+#include "Aligned.hpp"
+
+
+template <typename T>
+static T clip(T x) {
+	// return std::tanh(x);
+	// Pade approximant of tanh
+	x = simd::clamp(x, -3.f, 3.f);
+	return x * (27 + x * x) / (27 + 9 * x * x);
+}
+
+
+template <typename T>
+struct LadderFilter {
+	T omega0;
+	T resonance = 1;
+	T state[4];
+	T input;
+
+	LadderFilter() {
+		reset();
+		setCutoff(0);
+	}
+
+	void reset() {
+		for (int i = 0; i < 4; i++) {
+			state[i] = 0;
+		}
+	}
+
+	void setCutoff(T cutoff) {
+		omega0 = 2 * T(M_PI) * cutoff;
+	}
+
+	void process(T input, T dt) {
+		dsp::stepRK4(T(0), dt, state, 4, [&](T t, const T x[], T dxdt[]) {
+			T inputt = crossfade(this->input, input, t / dt);
+			T inputc = clip(inputt - resonance * x[3]);
+			T yc0 = clip(x[0]);
+			T yc1 = clip(x[1]);
+			T yc2 = clip(x[2]);
+			T yc3 = clip(x[3]);
+
+			dxdt[0] = omega0 * (inputc - yc0);
+			dxdt[1] = omega0 * (yc0 - yc1);
+			dxdt[2] = omega0 * (yc1 - yc2);
+			dxdt[3] = omega0 * (yc2 - yc3);
+		});
+
+		this->input = input;
+	}
+
+	T lowpass() {
+		return state[3];
+	}
+	T highpass() {
+		return clip((input - resonance * state[3]) - 4 * state[0] + 6 * state[1] - 4 * state[2] + state[3]);
+	}
+};
+
+
+/** 16 channels of LadderFilter, so the SIMD vector width can be selected at runtime.
+Set the per-channel inputs, call process(), and read the per-channel outputs.
+*/
+struct LadderFilterBank : Aligned32 {
+	float input[16] = {};
+	float cutoff[16] = {};
+	float resonance[16] = {};
+
+	float lowpass[16] = {};
+	float highpass[16] = {};
+
+	virtual ~LadderFilterBank() {}
+	virtual void reset() = 0;
+	virtual void process(int channels, float deltaTime) = 0;
+};
+
+
+template <typename T>
+struct TLadderFilterBank : LadderFilterBank {
+	LadderFilter<T> filters[16 / T::size];
+
+	void reset() override {
+		for (LadderFilter<T>& filter : filters)
+			filter.reset();
+	}
+
+	void process(int channels, float deltaTime) override {
+		for (int c = 0; c < channels; c += T::size) {
+			LadderFilter<T>& filter = filters[c / T::size];
+			filter.resonance = T::load(&resonance[c]);
+			filter.setCutoff(T::load(&cutoff[c]));
+			filter.process(T::load(&input[c]), deltaTime);
+			filter.lowpass().store(&lowpass[c]);
+			filter.highpass().store(&highpass[c]);
+		}
+	}
+};
+
+
+/** Creates a LadderFilterBank with the widest SIMD vectors supported by the CPU. */
+LadderFilterBank* createLadderFilterBank();
+#if defined AVX2_CORES
+/** Defined in avx2/VCF.cpp, which is compiled with AVX2 and FMA instructions and keeps its inline functions local.
+Only call if hasAvx2() is true.
+*/
+LadderFilterBank* createLadderFilterBankAvx2();
+#endif
@@ -0,0 +1,107 @@
+#include "plugin.hpp"
+#include "MappedFile.hpp"
+
+#if defined ARCH_WIN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+#if defined ARCH_WIN
+	HANDLE file = CreateFileW(string::UTF8toUTF16(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	DEFER({CloseHandle(file);});
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		return NULL;
+
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+		return NULL;
+	// The view keeps the mapping open after its handle is closed.
+	DEFER({CloseHandle(mapping);});
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+		return NULL;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	// The map stays valid after the file is closed.
+	DEFER({::close(fd);});
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+		return NULL;
+	off_t size = st.st_size;
+
+	void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+#endif
+
+	std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>();
+	mappedFile->data = (const uint8_t*) data;
+#if defined ARCH_WIN
+	mappedFile->size = size.QuadPart;
+#else
+	mappedFile->size = size;
+#endif
+	return mappedFile;
+}
+
+
+MappedFile::~MappedFile() {
+	if (!data)
+		return;
+#if defined ARCH_WIN
+	UnmapViewOfFile(data);
+#else
+	munmap((void*) data, size);
+#endif
+}
+
+
+bool touchFile(const std::string& path) {
+#if defined ARCH_WIN
+	// Changing attributes doesn't conflict with the sharing mode of maps of the file.
+	HANDLE file = CreateFileW(string::UTF8toUTF16(path).c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	DEFER({CloseHandle(file);});
+
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	return SetFileTime(file, NULL, NULL, &now);
+#else
+	return utime(path.c_str(), NULL) == 0;
+#endif
+}
+
+
+bool MappedFile::prefault(const std::atomic<bool>* cancel) const {
+#if !defined ARCH_WIN
+	// Start reading the whole file ahead of the loop below
+	madvise((void*) data, size, MADV_WILLNEED);
+#endif
+	// Pages are at least 4 KB on every platform, so reading a byte every 4 KB touches every page.
+	const volatile uint8_t* bytes = data;
+	uint8_t sum = 0;
+	for (size_t i = 0; i < size; i += 4096) {
+		// Check every 1 MB
+		if (cancel && i % (1 << 20) == 0 && *cancel)
+			return false;
+		sum += bytes[i];
+	}
+	(void) sum;
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <rack.hpp>
+#include <atomic>
+
+
+/** Read-only memory map of a whole file.
+Pages are loaded on demand and shared through the OS page cache by all maps of the same file.
+The map sees later writes to the file, and reading past the end of a truncated file raises SIGBUS on POSIX.
+So only map files which are never modified in place, but replaced by renaming or removed, which leaves existing maps of the old file intact.
+*/
+struct MappedFile {
+	const uint8_t* data = NULL;
+	size_t size = 0;
+
+	/** Returns NULL if the file doesn't exist, is empty, or can't be mapped. */
+	static std::shared_ptr<MappedFile> open(const std::string& path);
+	~MappedFile();
+
+	/** Loads every page and maps it into this process, so later reads don't fault unless the OS reclaims the pages under memory pressure.
+	Reads the whole file, so call it on a worker thread before the audio thread reads the data.
+	Stops early and returns false when `cancel` is set.
+	*/
+	bool prefault(const std::atomic<bool>* cancel = NULL) const;
+};
+
+
+/** Sets the modification time of a file to now, even while it is mapped.
+Returns false if the file doesn't exist or its time can't be set.
+*/
+bool touchFile(const std::string& path);
@@ -0,0 +1,92 @@
+#pragma once
+#include <rack.hpp>
+
+
+/** Transposes a 4x4 matrix stored as 4 rows. */
+inline void transpose(simd::float_4 (&x)[4]) {
+	_MM_TRANSPOSE4_PS(x[0].v, x[1].v, x[2].v, x[3].v);
+}
+
+
+/** MinBLEP impulse with Z zero crossings and O points per crossing, stored as O + 1 rows of Z points, one row per subsample offset.
+Each lane reads contiguous points instead of points strided by O.
+Read-only and shared by all generators with the same Z and O.
+*/
+template <int Z, int O>
+struct MinBlepTable {
+	/** rows[k][j] = impulse[j * O + k] - 1 */
+	alignas(32) float rows[O + 1][Z];
+
+	MinBlepTable() {
+		float impulse[Z * O + 1];
+		dsp::minBlepImpulse(Z, O, impulse);
+		impulse[Z * O] = 1.f;
+		for (int k = 0; k <= O; k++) {
+			for (int j = 0; j < Z; j++) {
+				rows[k][j] = impulse[std::min(j * O + k, Z * O)] - 1.f;
+			}
+		}
+	}
+
+	/** Returns the table, computing it on first use. */
+	static const MinBlepTable& get() {
+		static const MinBlepTable table;
+		return table;
+	}
+};
+
+
+/** MinBLEP generator that inserts a discontinuity in every SIMD lane at once, each lane with its own subsample position.
+
+Produces the same output as calling dsp::MinBlepGenerator::insertDiscontinuity() once per lane.
+Z must be a multiple of the lane count.
+*/
+template <int Z, int O, typename T>
+struct BatchMinBlepGenerator {
+	static constexpr int N = T::size;
+	static_assert(Z % N == 0, "Z must be a multiple of the SIMD lane count");
+
+	T buf[2 * Z] = {};
+	int pos = 0;
+	const MinBlepTable<Z, O>* table = &MinBlepTable<Z, O>::get();
+
+	/** Places a discontinuity with magnitude `x[i]` at `p[i]` relative to the current frame, for every lane i.
+	Lanes with `p` outside (-1, 0] or with `x` equal to 0 are unchanged.
+	*/
+	void insertDiscontinuity(T p, T x) {
+		T valid = (-1.f < p) & (p <= 0.f);
+		x = valid & x;
+		T offset = simd::ifelse(valid, -p * O, 0.f);
+		T offset0 = simd::floor(offset);
+		T frac = offset - offset0;
+
+		const float* rows0[N];
+		const float* rows1[N];
+		for (int i = 0; i < N; i++) {
+			int k = std::min((int) offset0[i], O - 1);
+			rows0[i] = table->rows[k];
+			rows1[i] = table->rows[k + 1];
+		}
+
+		for (int j = 0; j < Z; j += N) {
+			// Compute N points of each lane's impulse, then transpose so each vector holds one point of all lanes.
+			T points[N];
+			for (int i = 0; i < N; i++) {
+				T y0 = T::load(&rows0[i][j]);
+				T y1 = T::load(&rows1[i][j]);
+				points[i] = (y0 + frac[i] * (y1 - y0)) * x[i];
+			}
+			transpose(points);
+			for (int i = 0; i < N; i++) {
+				buf[(pos + j + i) % (2 * Z)] += points[i];
+			}
+		}
+	}
+
+	T process() {
+		T v = buf[pos];
+		buf[pos] = 0.f;
+		pos = (pos + 1) % (2 * Z);
+		return v;
+	}
+};
@@ -1,67 +1,10 @@
 #include "plugin.hpp"
+#include "LadderFilter.hpp"
 
 
 using simd::float_4;
 
 
-template <typename T>
-static T clip(T x) {
-	// return std::tanh(x);
-	// Pade approximant of tanh
-	x = simd::clamp(x, -3.f, 3.f);
-	return x * (27 + x * x) / (27 + 9 * x * x);
-}
-
-
-template <typename T>
-struct LadderFilter {
-	T omega0;
-	T resonance = 1;
-	T state[4];
-	T input;
-
-	LadderFilter() {
-		reset();
-		setCutoff(0);
-	}
-
-	void reset() {
-		for (int i = 0; i < 4; i++) {
-			state[i] = 0;
-		}
-	}
-
-	void setCutoff(T cutoff) {
-		omega0 = 2 * T(M_PI) * cutoff;
-	}
-
-	void process(T input, T dt) {
-		dsp::stepRK4(T(0), dt, state, 4, [&](T t, const T x[], T dxdt[]) {
-			T inputt = crossfade(this->input, input, t / dt);
-			T inputc = clip(inputt - resonance * x[3]);
-			T yc0 = clip(x[0]);
-			T yc1 = clip(x[1]);
-			T yc2 = clip(x[2]);
-			T yc3 = clip(x[3]);
-
-			dxdt[0] = omega0 * (inputc - yc0);
-			dxdt[1] = omega0 * (yc0 - yc1);
-			dxdt[2] = omega0 * (yc1 - yc2);
-			dxdt[3] = omega0 * (yc2 - yc3);
-		});
-
-		this->input = input;
-	}
-
-	T lowpass() {
-		return state[3];
-	}
-	T highpass() {
-		return clip((input - resonance * state[3]) - 4 * state[0] + 6 * state[1] - 4 * state[2] + state[3]);
-	}
-};
-
-
 static const int UPSAMPLE = 2;
 
 struct VCF : Module {
@@ -89,7 +32,7 @@ struct VCF : Module {
 		NUM_OUTPUTS
 	};
 
-	LadderFilter<float_4> filters[4];
+	std::unique_ptr<LadderFilterBank> filterBank;
 	// Upsampler<UPSAMPLE, 8> inputUpsampler;
 	// Decimator<UPSAMPLE, 8> lowpassDecimator;
 	// Decimator<UPSAMPLE, 8> highpassDecimator;
@@ -124,11 +67,12 @@ struct VCF : Module {
 
 		configBypass(IN_INPUT, LPF_OUTPUT);
 		configBypass(IN_INPUT, HPF_OUTPUT);
+
+		filterBank.reset(createLadderFilterBank());
 	}
 
 	void onReset() override {
-		for (int i = 0; i < 4; i++)
-			filters[i].reset();
+		filterBank->reset();
 	}
 
 	void process(const ProcessArgs& args) override {
@@ -147,9 +91,9 @@ struct VCF : Module {
 
 		int channels = std::max(1, inputs[IN_INPUT].getChannels());
 
-		for (int c = 0; c < channels; c += 4) {
-			auto& filter = filters[c / 4];
+		LadderFilterBank& bank = *filterBank;
 
+		for (int c = 0; c < channels; c += 4) {
 			float_4 input = inputs[IN_INPUT].getVoltageSimd<float_4>(c) / 5.f;
 
 			// Drive gain
@@ -164,7 +108,8 @@ struct VCF : Module {
 			// Set resonance
 			float_4 resonance = resParam + inputs[RES_INPUT].getPolyVoltageSimd<float_4>(c) / 10.f * resCvParam;
 			resonance = clamp(resonance, 0.f, 1.f);
-			filter.resonance = simd::pow(resonance, 2) * 10.f;
+			resonance = simd::pow(resonance, 2) * 10.f;
+			resonance.store(&bank.resonance[c]);
 
 			// Get pitch
 			float_4 pitch = freqParam + inputs[FREQ_INPUT].getPolyVoltageSimd<float_4>(c) * freqCvParam;
@@ -172,7 +117,7 @@ struct VCF : Module {
 			float_4 cutoff = dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
 			// Without oversampling, we must limit to 8000 Hz or so @ 44100 Hz
 			cutoff = clamp(cutoff, 1.f, args.sampleRate * 0.18f);
-			filter.setCutoff(cutoff);
+			cutoff.store(&bank.cutoff[c]);
 
 			// Upsample input
 			// float dt = args.sampleTime / UPSAMPLE;
@@ -197,13 +142,18 @@ struct VCF : Module {
 			// 	outputs[HPF_OUTPUT].setVoltage(5.f * highpassDecimator.process(highpassBuf));
 			// }
 
-			// Set outputs
-			filter.process(input, args.sampleTime);
+			input.store(&bank.input[c]);
+		}
+
+		bank.process(channels, args.sampleTime);
+
+		// Set outputs
+		for (int c = 0; c < channels; c += 4) {
 			if (outputs[LPF_OUTPUT].isConnected()) {
-				outputs[LPF_OUTPUT].setVoltageSimd(5.f * filter.lowpass(), c);
+				outputs[LPF_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.lowpass[c]), c);
 			}
 			if (outputs[HPF_OUTPUT].isConnected()) {
-				outputs[HPF_OUTPUT].setVoltageSimd(5.f * filter.highpass(), c);
+				outputs[HPF_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.highpass[c]), c);
 			}
 		}
 
@@ -249,4 +199,13 @@ struct VCFWidget : ModuleWidget {
 };
 
 
+LadderFilterBank* createLadderFilterBank() {
+#if defined AVX2_CORES
+	if (hasAvx2())
+		return createLadderFilterBankAvx2();
+#endif
+	return new TLadderFilterBank<float_4>;
+}
+
+
 Model* modelVCF = createModel<VCF, VCFWidget>("VCF");
@@ -1,242 +1,32 @@
 #include "plugin.hpp"
+#include "VoltageControlledOscillator.hpp"
 
 
 using simd::float_4;
 
 
-// Accurate only on [0, 1]
-template <typename T>
-T sin2pi_pade_05_7_6(T x) {
-	x -= 0.5f;
-	return (T(-6.28319) * x + T(35.353) * simd::pow(x, 3) - T(44.9043) * simd::pow(x, 5) + T(16.0951) * simd::pow(x, 7))
-	       / (1 + T(0.953136) * simd::pow(x, 2) + T(0.430238) * simd::pow(x, 4) + T(0.0981408) * simd::pow(x, 6));
-}
-
-template <typename T>
-T sin2pi_pade_05_5_4(T x) {
-	x -= 0.5f;
-	return (T(-6.283185307) * x + T(33.19863968) * simd::pow(x, 3) - T(32.44191367) * simd::pow(x, 5))
-	       / (1 + T(1.296008659) * simd::pow(x, 2) + T(0.7028072946) * simd::pow(x, 4));
-}
-
-template <typename T>
-T expCurve(T x) {
-	return (3 + x * (-13 + 5 * x)) / (3 + 2 * x);
-}
-
-
-template <int OVERSAMPLE, int QUALITY, typename T>
-struct VoltageControlledOscillator {
-	bool analog = false;
-	bool soft = false;
-	bool syncEnabled = false;
-	// For optimizing in serial code
-	int channels = 0;
-
-	T lastSyncValue = 0.f;
-	T phase = 0.f;
-	T freq = 0.f;
-	T pulseWidth = 0.5f;
-	T syncDirection = 1.f;
-
-	dsp::TRCFilter<T> sqrFilter;
-
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sqrMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sawMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> triMinBlep;
-	dsp::MinBlepGenerator<QUALITY, OVERSAMPLE, T> sinMinBlep;
-
-	T sqrValue = 0.f;
-	T sawValue = 0.f;
-	T triValue = 0.f;
-	T sinValue = 0.f;
-
-	void setPulseWidth(T pulseWidth) {
-		const float pwMin = 0.01f;
-		this->pulseWidth = simd::clamp(pulseWidth, pwMin, 1.f - pwMin);
-	}
-
-	void process(float deltaTime, T syncValue) {
-		// Advance phase
-		T deltaPhase = simd::clamp(freq * deltaTime, 0.f, 0.35f);
-		if (soft) {
-			// Reverse direction
-			deltaPhase *= syncDirection;
-		}
-		else {
-			// Reset back to forward
-			syncDirection = 1.f;
-		}
-		phase += deltaPhase;
-		// Wrap phase
-		phase -= simd::floor(phase);
-
-		// Jump sqr when crossing 0, or 1 if backwards
-		T wrapPhase = (syncDirection == -1.f) & 1.f;
-		T wrapCrossing = (wrapPhase - (phase - deltaPhase)) / deltaPhase;
-		int wrapMask = simd::movemask((0 < wrapCrossing) & (wrapCrossing <= 1.f));
-		if (wrapMask) {
-			for (int i = 0; i < channels; i++) {
-				if (wrapMask & (1 << i)) {
-					T mask = simd::movemaskInverse<T>(1 << i);
-					float p = wrapCrossing[i] - 1.f;
-					T x = mask & (2.f * syncDirection);
-					sqrMinBlep.insertDiscontinuity(p, x);
-				}
-			}
-		}
-
-		// Jump sqr when crossing `pulseWidth`
-		T pulseCrossing = (pulseWidth - (phase - deltaPhase)) / deltaPhase;
-		int pulseMask = simd::movemask((0 < pulseCrossing) & (pulseCrossing <= 1.f));
-		if (pulseMask) {
-			for (int i = 0; i < channels; i++) {
-				if (pulseMask & (1 << i)) {
-					T mask = simd::movemaskInverse<T>(1 << i);
-					float p = pulseCrossing[i] - 1.f;
-					T x = mask & (-2.f * syncDirection);
-					sqrMinBlep.insertDiscontinuity(p, x);
-				}
-			}
-		}
-
-		// Jump saw when crossing 0.5
-		T halfCrossing = (0.5f - (phase - deltaPhase)) / deltaPhase;
-		int halfMask = simd::movemask((0 < halfCrossing) & (halfCrossing <= 1.f));
-		if (halfMask) {
-			for (int i = 0; i < channels; i++) {
-				if (halfMask & (1 << i)) {
-					T mask = simd::movemaskInverse<T>(1 << i);
-					float p = halfCrossing[i] - 1.f;
-					T x = mask & (-2.f * syncDirection);
-					sawMinBlep.insertDiscontinuity(p, x);
-				}
-			}
-		}
+/** Enough 16-lane banks for 16 channels with 16 unison voices each */
+static const int MAX_OSCILLATOR_BANKS = 16;
 
-		// Detect sync
-		// Might be NAN or outside of [0, 1) range
-		if (syncEnabled) {
-			T deltaSync = syncValue - lastSyncValue;
-			T syncCrossing = -lastSyncValue / deltaSync;
-			lastSyncValue = syncValue;
-			T sync = (0.f < syncCrossing) & (syncCrossing <= 1.f) & (syncValue >= 0.f);
-			int syncMask = simd::movemask(sync);
-			if (syncMask) {
-				if (soft) {
-					syncDirection = simd::ifelse(sync, -syncDirection, syncDirection);
-				}
-				else {
-					T newPhase = simd::ifelse(sync, (1.f - syncCrossing) * deltaPhase, phase);
-					// Insert minBLEP for sync
-					for (int i = 0; i < channels; i++) {
-						if (syncMask & (1 << i)) {
-							T mask = simd::movemaskInverse<T>(1 << i);
-							float p = syncCrossing[i] - 1.f;
-							T x;
-							x = mask & (sqr(newPhase) - sqr(phase));
-							sqrMinBlep.insertDiscontinuity(p, x);
-							x = mask & (saw(newPhase) - saw(phase));
-							sawMinBlep.insertDiscontinuity(p, x);
-							x = mask & (tri(newPhase) - tri(phase));
-							triMinBlep.insertDiscontinuity(p, x);
-							x = mask & (sin(newPhase) - sin(phase));
-							sinMinBlep.insertDiscontinuity(p, x);
-						}
-					}
-					phase = newPhase;
-				}
-			}
-		}
-
-		// Square
-		sqrValue = sqr(phase);
-		sqrValue += sqrMinBlep.process();
-
-		if (analog) {
-			sqrFilter.setCutoffFreq(20.f * deltaTime);
-			sqrFilter.process(sqrValue);
-			sqrValue = sqrFilter.highpass() * 0.95f;
-		}
-
-		// Saw
-		sawValue = saw(phase);
-		sawValue += sawMinBlep.process();
-
-		// Tri
-		triValue = tri(phase);
-		triValue += triMinBlep.process();
-
-		// Sin
-		sinValue = sin(phase);
-		sinValue += sinMinBlep.process();
-	}
-
-	T sin(T phase) {
-		T v;
-		if (analog) {
-			// Quadratic approximation of sine, slightly richer harmonics
-			T halfPhase = (phase < 0.5f);
-			T x = phase - simd::ifelse(halfPhase, 0.25f, 0.75f);
-			v = 1.f - 16.f * simd::pow(x, 2);
-			v *= simd::ifelse(halfPhase, 1.f, -1.f);
-		}
-		else {
-			v = sin2pi_pade_05_5_4(phase);
-			// v = sin2pi_pade_05_7_6(phase);
-			// v = simd::sin(2 * T(M_PI) * phase);
-		}
-		return v;
-	}
-	T sin() {
-		return sinValue;
-	}
 
-	T tri(T phase) {
-		T v;
-		if (analog) {
-			T x = phase + 0.25f;
-			x -= simd::trunc(x);
-			T halfX = (x >= 0.5f);
-			x *= 2;
-			x -= simd::trunc(x);
-			v = expCurve(x) * simd::ifelse(halfX, 1.f, -1.f);
-		}
-		else {
-			v = 1 - 4 * simd::fmin(simd::fabs(phase - 0.25f), simd::fabs(phase - 1.25f));
-		}
-		return v;
-	}
-	T tri() {
-		return triValue;
-	}
+/** Oscillator banks for every lane possible with one quality, oversampling and unison setting.
+Created on the UI thread, so process() never allocates.
+*/
+struct OscillatorBankSet {
+	/** Lane `c * unison + v` is unison voice v of channel c. */
+	std::unique_ptr<OscillatorBank> banks[MAX_OSCILLATOR_BANKS];
+	int unison;
+	/** Set by process() once it has loaded the controls into the banks */
+	bool used = false;
 
-	T saw(T phase) {
-		T v;
-		T x = phase + 0.5f;
-		x -= simd::trunc(x);
-		if (analog) {
-			v = -expCurve(x);
+	OscillatorBankSet(int quality, int oversampling, int unison) : unison(unison) {
+		// 16 channels of `unison` voices fill `unison` banks.
+		for (int b = 0; b < unison; b++) {
+			banks[b].reset(createOscillatorBank(quality, oversampling));
+			// Stacked unison voices shouldn't start in phase
+			if (unison > 1)
+				banks[b]->randomizePhases();
 		}
-		else {
-			v = 2 * x - 1;
-		}
-		return v;
-	}
-	T saw() {
-		return sawValue;
-	}
-
-	T sqr(T phase) {
-		T v = simd::ifelse(phase < pulseWidth, 1.f, -1.f);
-		return v;
-	}
-	T sqr() {
-		return sqrValue;
-	}
-
-	T light() {
-		return simd::sin(2 * T(M_PI) * phase);
 	}
 };
 
@@ -252,6 +42,7 @@ struct VCO : Module {
 		PW_CV_PARAM,
 		// new in 2.0
 		LINEAR_PARAM,
+		SPREAD_PARAM,
 		NUM_PARAMS
 	};
 	enum InputIds {
@@ -275,8 +66,34 @@ struct VCO : Module {
 		NUM_LIGHTS
 	};
 
-	VoltageControlledOscillator<16, 16, float_4> oscillators[4];
+	/** Banks used by process(), replaced by updateBanks() on the UI thread */
+	std::atomic<OscillatorBankSet*> bankSet;
+	/** Set held by process(), which the UI thread must not delete */
+	std::atomic<OscillatorBankSet*> bankSetHazard;
+	/** Replaced sets which process() may still have held, deleted by updateBanks() */
+	std::vector<OscillatorBankSet*> retiredBankSets;
 	dsp::ClockDivider lightDivider;
+	/** minBLEP size: Eco, Standard, or High */
+	int quality;
+	/** log2 of the oversampling factor */
+	int oversampling;
+	/** Number of detuned voices per channel */
+	int unison;
+	/** Frequency ratio of each unison voice, for detuneSpread and detuneUnison */
+	float detuneRatios[16];
+	float detuneSpread = -1.f;
+	int detuneUnison = 0;
+
+	/** Controls that the bank frequencies and pulse widths were last computed from.
+	They are only recomputed when one of these changes.
+	*/
+	float_4 lastParams = NAN;
+	float_4 lastPitches[4] = {};
+	float_4 lastFms[4] = {};
+	float_4 lastPws[4] = {};
+	bool lastLinear = false;
+	float lastSampleRate = 0.f;
+	int lastLanes = 0;
 
 	VCO() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -288,6 +105,9 @@ struct VCO : Module {
 		configParam(PW_PARAM, 0.01f, 0.99f, 0.5f, "Pulse width", "%", 0.f, 100.f);
 		configParam(PW_CV_PARAM, -1.f, 1.f, 0.f, "Pulse width modulation", "%", 0.f, 100.f);
 		getParamQuantity(PW_CV_PARAM)->randomizeEnabled = false;
+		// The panel has no room for another knob, so the spread is set with a slider in the context menu.
+		configParam(SPREAD_PARAM, 0.f, 1.f, 0.2f, "Unison spread", " cents", 0.f, 100.f);
+		getParamQuantity(SPREAD_PARAM)->randomizeEnabled = false;
 
 		configInput(PITCH_INPUT, "1V/octave pitch");
 		configInput(FM_INPUT, "Frequency modulation");
@@ -299,7 +119,54 @@ struct VCO : Module {
 		configOutput(SAW_OUTPUT, "Sawtooth");
 		configOutput(SQR_OUTPUT, "Square");
 
+		bankSet = NULL;
+		bankSetHazard = NULL;
 		lightDivider.setDivision(16);
+		onReset();
+	}
+
+	~VCO() {
+		delete bankSet.load();
+		for (OscillatorBankSet* set : retiredBankSets) {
+			delete set;
+		}
+	}
+
+	void onReset() override {
+		quality = 1;
+		oversampling = 0;
+		unison = 1;
+		updateBanks();
+	}
+
+	/** Replaces the banks with new ones for the current quality, oversampling and unison settings.
+	Call from the UI thread after changing them. Deletes replaced banks once process() is done with them.
+	*/
+	void updateBanks() {
+		OscillatorBankSet* oldSet = bankSet.exchange(new OscillatorBankSet(quality, oversampling, unison));
+		if (oldSet)
+			retiredBankSets.push_back(oldSet);
+		retiredBankSets.erase(std::remove_if(retiredBankSets.begin(), retiredBankSets.end(), [&](OscillatorBankSet* set) {
+			if (set == bankSetHazard.load())
+				return false;
+			delete set;
+			return true;
+		}), retiredBankSets.end());
+	}
+
+	/** Spreads voices evenly from -spread to +spread semitones.
+	Returns whether the ratios changed.
+	*/
+	bool updateDetune(int voices, float spread) {
+		if (voices == detuneUnison && spread == detuneSpread)
+			return false;
+		detuneUnison = voices;
+		detuneSpread = spread;
+		for (int v = 0; v < voices; v++) {
+			float detune = (voices > 1) ? spread * (2.f * v / (voices - 1) - 1.f) : 0.f;
+			detuneRatios[v] = std::pow(2.f, detune / 12.f);
+		}
+		return true;
 	}
 
 	void process(const ProcessArgs& args) override {
@@ -310,46 +177,145 @@ struct VCO : Module {
 		bool linear = params[LINEAR_PARAM].getValue() > 0.f;
 		bool soft = params[SYNC_PARAM].getValue() <= 0.f;
 
-		int channels = std::max(inputs[PITCH_INPUT].getChannels(), 1);
+		// Hold the banks so updateBanks() doesn't delete them while processing
+		OscillatorBankSet* set = bankSet.load();
+		while (true) {
+			bankSetHazard.store(set);
+			// If the set was replaced before the hazard was stored, updateBanks() might not have seen the hazard, so try again.
+			OscillatorBankSet* set2 = bankSet.load();
+			if (set2 == set)
+				break;
+			set = set2;
+		}
+		DEFER({bankSetHazard.store(NULL, std::memory_order_release);});
+		std::unique_ptr<OscillatorBank>* oscillatorBanks = set->banks;
 
+		int channels = std::max(inputs[PITCH_INPUT].getChannels(), 1);
+		int voices = set->unison;
+		int lanes = channels * voices;
+		// New banks need the controls loaded
+		bool controlsChanged = !set->used;
+		set->used = true;
+		controlsChanged |= updateDetune(voices, params[SPREAD_PARAM].getValue());
+
+		// Only compute waveforms of connected outputs
+		int waves = 0;
+		if (outputs[SIN_OUTPUT].isConnected())
+			waves |= SIN_FLAG;
+		if (outputs[TRI_OUTPUT].isConnected())
+			waves |= TRI_FLAG;
+		if (outputs[SAW_OUTPUT].isConnected())
+			waves |= SAW_FLAG;
+		if (outputs[SQR_OUTPUT].isConnected())
+			waves |= SQR_FLAG;
+
+		// Detect changes of the controls, which are constant for most voices
+		float_4 params4 = float_4(freqParam, fmParam, pwParam, pwCvParam);
+		controlsChanged |= simd::movemask(params4 != lastParams) || linear != lastLinear || args.sampleRate != lastSampleRate || lanes != lastLanes;
+		lastParams = params4;
+		lastLinear = linear;
+		lastSampleRate = args.sampleRate;
+		lastLanes = lanes;
 		for (int c = 0; c < channels; c += 4) {
-			auto& oscillator = oscillators[c / 4];
-			oscillator.channels = std::min(channels - c, 4);
+			float_4 pitch = inputs[PITCH_INPUT].getPolyVoltageSimd<float_4>(c);
+			float_4 fm = inputs[FM_INPUT].getPolyVoltageSimd<float_4>(c);
+			float_4 pw = inputs[PW_INPUT].getPolyVoltageSimd<float_4>(c);
+			controlsChanged |= simd::movemask((pitch != lastPitches[c / 4]) | (fm != lastFms[c / 4]) | (pw != lastPws[c / 4]));
+			lastPitches[c / 4] = pitch;
+			lastFms[c / 4] = fm;
+			lastPws[c / 4] = pw;
+		}
+
+		if (controlsChanged) {
+			float freqs[16];
+			float pulseWidths[16];
+			for (int c = 0; c < channels; c += 4) {
+				// Get frequency
+				float_4 pitch = freqParam + lastPitches[c / 4];
+				float_4 freq;
+				if (!linear) {
+					pitch += lastFms[c / 4] * fmParam;
+					freq = dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
+				}
+				else {
+					freq = dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
+					freq += dsp::FREQ_C4 * lastFms[c / 4] * fmParam;
+				}
+				freq = clamp(freq, 0.f, args.sampleRate / 2.f);
+				freq.store(&freqs[c]);
+
+				// Get pulse width
+				float_4 pw = pwParam + lastPws[c / 4] / 10.f * pwCvParam;
+				pw.store(&pulseWidths[c]);
+			}
+
+			// Distribute channels to unison voices
+			for (int l = 0; l < lanes; l++) {
+				int c = l / voices;
+				OscillatorBank& bank = *oscillatorBanks[l / 16];
+				bank.freq[l % 16] = freqs[c] * detuneRatios[l % voices];
+				bank.pulseWidth[l % 16] = pulseWidths[c];
+			}
+		}
+
+		bool syncEnabled = inputs[SYNC_INPUT].isConnected();
+		if (syncEnabled) {
+			float syncs[16];
+			for (int c = 0; c < channels; c += 4) {
+				float_4 sync = inputs[SYNC_INPUT].getPolyVoltageSimd<float_4>(c);
+				sync.store(&syncs[c]);
+			}
+			for (int l = 0; l < lanes; l++) {
+				oscillatorBanks[l / 16]->sync[l % 16] = syncs[l / voices];
+			}
+		}
+
+		for (int b = 0; b < (lanes + 15) / 16; b++) {
+			OscillatorBank& bank = *oscillatorBanks[b];
 			// removed
-			oscillator.analog = true;
-			oscillator.soft = soft;
-
-			// Get frequency
-			float_4 pitch = freqParam + inputs[PITCH_INPUT].getPolyVoltageSimd<float_4>(c);
-			float_4 freq;
-			if (!linear) {
-				pitch += inputs[FM_INPUT].getPolyVoltageSimd<float_4>(c) * fmParam;
-				freq = dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
+			bank.analog = true;
+			bank.soft = soft;
+			bank.syncEnabled = syncEnabled;
+			bank.waves = waves;
+			bank.controlsChanged = controlsChanged;
+			bank.process(std::min(lanes - b * 16, 16), args.sampleTime);
+		}
+
+		// Set output
+		if (voices == 1) {
+			OscillatorBank& bank = *oscillatorBanks[0];
+			for (int c = 0; c < channels; c += 4) {
+				if (outputs[SIN_OUTPUT].isConnected())
+					outputs[SIN_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.sin[c]), c);
+				if (outputs[TRI_OUTPUT].isConnected())
+					outputs[TRI_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.tri[c]), c);
+				if (outputs[SAW_OUTPUT].isConnected())
+					outputs[SAW_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.saw[c]), c);
+				if (outputs[SQR_OUTPUT].isConnected())
+					outputs[SQR_OUTPUT].setVoltageSimd(5.f * float_4::load(&bank.sqr[c]), c);
 			}
-			else {
-				freq = dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
-				freq += dsp::FREQ_C4 * inputs[FM_INPUT].getPolyVoltageSimd<float_4>(c) * fmParam;
+		}
+		else {
+			// Sum voices of each channel, keeping the level of uncorrelated voices constant
+			float sin[16] = {};
+			float tri[16] = {};
+			float saw[16] = {};
+			float sqr[16] = {};
+			for (int l = 0; l < lanes; l++) {
+				int c = l / voices;
+				OscillatorBank& bank = *oscillatorBanks[l / 16];
+				sin[c] += bank.sin[l % 16];
+				tri[c] += bank.tri[l % 16];
+				saw[c] += bank.saw[l % 16];
+				sqr[c] += bank.sqr[l % 16];
+			}
+			float gain = 5.f / std::sqrt(voices);
+			for (int c = 0; c < channels; c++) {
+				outputs[SIN_OUTPUT].setVoltage(gain * sin[c], c);
+				outputs[TRI_OUTPUT].setVoltage(gain * tri[c], c);
+				outputs[SAW_OUTPUT].setVoltage(gain * saw[c], c);
+				outputs[SQR_OUTPUT].setVoltage(gain * sqr[c], c);
 			}
-			freq = clamp(freq, 0.f, args.sampleRate / 2.f);
-			oscillator.freq = freq;
-
-			// Get pulse width
-			float_4 pw = pwParam + inputs[PW_INPUT].getPolyVoltageSimd<float_4>(c) / 10.f * pwCvParam;
-			oscillator.setPulseWidth(pw);
-
-			oscillator.syncEnabled = inputs[SYNC_INPUT].isConnected();
-			float_4 sync = inputs[SYNC_INPUT].getPolyVoltageSimd<float_4>(c);
-			oscillator.process(args.sampleTime, sync);
-
-			// Set output
-			if (outputs[SIN_OUTPUT].isConnected())
-				outputs[SIN_OUTPUT].setVoltageSimd(5.f * oscillator.sin(), c);
-			if (outputs[TRI_OUTPUT].isConnected())
-				outputs[TRI_OUTPUT].setVoltageSimd(5.f * oscillator.tri(), c);
-			if (outputs[SAW_OUTPUT].isConnected())
-				outputs[SAW_OUTPUT].setVoltageSimd(5.f * oscillator.saw(), c);
-			if (outputs[SQR_OUTPUT].isConnected())
-				outputs[SQR_OUTPUT].setVoltageSimd(5.f * oscillator.sqr(), c);
 		}
 
 		outputs[SIN_OUTPUT].setChannels(channels);
@@ -360,7 +326,7 @@ struct VCO : Module {
 		// Light
 		if (lightDivider.process()) {
 			if (channels == 1) {
-				float lightValue = oscillators[0].light()[0];
+				float lightValue = std::sin(2 * float(M_PI) * oscillatorBanks[0]->getPhase());
 				lights[PHASE_LIGHT + 0].setSmoothBrightness(-lightValue, args.sampleTime * lightDivider.getDivision());
 				lights[PHASE_LIGHT + 1].setSmoothBrightness(lightValue, args.sampleTime * lightDivider.getDivision());
 				lights[PHASE_LIGHT + 2].setBrightness(0.f);
@@ -374,6 +340,36 @@ struct VCO : Module {
 			lights[SOFT_LIGHT].setBrightness(soft);
 		}
 	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "quality", json_integer(quality));
+		json_object_set_new(rootJ, "oversampling", json_integer(oversampling));
+		json_object_set_new(rootJ, "unison", json_integer(unison));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		int oldQuality = quality;
+		int oldOversampling = oversampling;
+		int oldUnison = unison;
+
+		json_t* qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ)
+			quality = clamp((int) json_integer_value(qualityJ), 0, NUM_OSCILLATOR_QUALITIES - 1);
+
+		json_t* oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ)
+			oversampling = clamp((int) json_integer_value(oversamplingJ), 0, NUM_OSCILLATOR_OVERSAMPLINGS - 1);
+
+		json_t* unisonJ = json_object_get(rootJ, "unison");
+		if (unisonJ)
+			unison = clamp((int) json_integer_value(unisonJ), 1, MAX_OSCILLATOR_BANKS);
+
+		// New banks restart the oscillators, so keep the current ones when loading the same settings, as on undo or duplicate.
+		if (quality != oldQuality || oversampling != oldOversampling || unison != oldUnison)
+			updateBanks();
+	}
 };
 
 
@@ -406,7 +402,46 @@ struct VCOWidget : ModuleWidget {
 
 		addChild(createLightCentered<SmallLight<RedGreenBlueLight>>(mm2px(Vec(31.089, 16.428)), module, VCO::PHASE_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		VCO* module = getModule<VCO>();
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createIndexSubmenuItem("Quality", {"Eco", "Standard", "High"},
+			[=]() {return module->quality;},
+			[=](int i) {module->quality = i; module->updateBanks();}
+		));
+		menu->addChild(createIndexSubmenuItem("Oversampling", {"1x", "2x", "4x"},
+			[=]() {return module->oversampling;},
+			[=](int i) {module->oversampling = i; module->updateBanks();}
+		));
+
+		std::vector<std::string> unisonLabels;
+		unisonLabels.push_back("Off");
+		for (int i = 2; i <= 16; i++) {
+			unisonLabels.push_back(string::f("%d", i));
+		}
+		menu->addChild(createIndexSubmenuItem("Unison voices", unisonLabels,
+			[=]() {return module->unison - 1;},
+			[=](int i) {module->unison = i + 1; module->updateBanks();}
+		));
+
+		ui::Slider* spreadSlider = new ui::Slider;
+		spreadSlider->quantity = module->getParamQuantity(VCO::SPREAD_PARAM);
+		spreadSlider->box.size.x = 200.f;
+		menu->addChild(spreadSlider);
+	}
 };
 
 
+OscillatorBank* createOscillatorBank(int quality, int oversampling) {
+#if defined AVX2_CORES
+	if (hasAvx2())
+		return createOscillatorBankAvx2(quality, oversampling);
+#endif
+	return newOscillatorBank<float_4>(quality, oversampling);
+}
+
+
 Model* modelVCO = createModel<VCO, VCOWidget>("VCO");
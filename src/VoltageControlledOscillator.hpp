@@ -0,0 +1,451 @@
+#pragma once
+#include <rack.hpp>
+#include "Aligned.hpp"
+#include "MinBlep.hpp"
+
+
+// Accurate only on [0, 1]
+template <typename T>
+T sin2pi_pade_05_7_6(T x) {
+	x -= 0.5f;
+	return (T(-6.28319) * x + T(35.353) * simd::pow(x, 3) - T(44.9043) * simd::pow(x, 5) + T(16.0951) * simd::pow(x, 7))
+	       / (1 + T(0.953136) * simd::pow(x, 2) + T(0.430238) * simd::pow(x, 4) + T(0.0981408) * simd::pow(x, 6));
+}
+
+template <typename T>
+T sin2pi_pade_05_5_4(T x) {
+	x -= 0.5f;
+	return (T(-6.283185307) * x + T(33.19863968) * simd::pow(x, 3) - T(32.44191367) * simd::pow(x, 5))
+	       / (1 + T(1.296008659) * simd::pow(x, 2) + T(0.7028072946) * simd::pow(x, 4));
+}
+
+template <typename T>
+T expCurve(T x) {
+	return (3 + x * (-13 + 5 * x)) / (3 + 2 * x);
+}
+
+
+/** Flags selecting a specialization of VoltageControlledOscillator::process().
+The analog mode only changes the waveform shapes, so it is a runtime branch instead of a flag.
+*/
+enum OscillatorFlags {
+	SIN_FLAG = 1 << 0,
+	TRI_FLAG = 1 << 1,
+	SAW_FLAG = 1 << 2,
+	SQR_FLAG = 1 << 3,
+	WAVE_FLAGS = SIN_FLAG | TRI_FLAG | SAW_FLAG | SQR_FLAG,
+	SYNC_FLAG = 1 << 4,
+	/** Only set with SYNC_FLAG. Without a sync input, soft and hard sync both run forward. */
+	SOFT_FLAG = 1 << 5,
+	NUM_FLAG_COMBINATIONS = 1 << 6,
+};
+
+
+template <int OVERSAMPLE, int QUALITY, typename T>
+struct VoltageControlledOscillator {
+	bool analog = false;
+	bool soft = false;
+	bool syncEnabled = false;
+	/** Bitmask of waveforms to compute, from SIN_FLAG, TRI_FLAG, SAW_FLAG, and SQR_FLAG.
+	Disabled waveforms are not computed and their values are left unchanged.
+	*/
+	int waves = WAVE_FLAGS;
+	// For optimizing in serial code
+	int channels = 0;
+
+	T lastSyncValue = 0.f;
+	T phase = 0.f;
+	T freq = 0.f;
+	T pulseWidth = 0.5f;
+	T syncDirection = 1.f;
+
+	dsp::TRCFilter<T> sqrFilter;
+
+	BatchMinBlepGenerator<QUALITY, OVERSAMPLE, T> sqrMinBlep;
+	BatchMinBlepGenerator<QUALITY, OVERSAMPLE, T> sawMinBlep;
+	BatchMinBlepGenerator<QUALITY, OVERSAMPLE, T> triMinBlep;
+	BatchMinBlepGenerator<QUALITY, OVERSAMPLE, T> sinMinBlep;
+
+	T sqrValue = 0.f;
+	T sawValue = 0.f;
+	T triValue = 0.f;
+	T sinValue = 0.f;
+
+	typedef void (VoltageControlledOscillator::*ProcessFunction)(float deltaTime, T syncValue);
+
+	/** Table of process() specializations indexed by OscillatorFlags.
+	Entries with SOFT_FLAG but not SYNC_FLAG are never used, so they don't instantiate process().
+	*/
+	struct ProcessFunctions {
+		ProcessFunction functions[NUM_FLAG_COMBINATIONS];
+
+		template <int FLAGS, typename Dummy = void>
+		struct Filler {
+			static void fill(ProcessFunction* functions) {
+				const bool used = !(FLAGS & SOFT_FLAG) || (FLAGS & SYNC_FLAG);
+				functions[FLAGS] = &VoltageControlledOscillator::template process<used ? FLAGS : (FLAGS & ~SOFT_FLAG)>;
+				Filler<FLAGS - 1>::fill(functions);
+			}
+		};
+		template <typename Dummy>
+		struct Filler<-1, Dummy> {
+			static void fill(ProcessFunction* functions) {}
+		};
+
+		ProcessFunctions() {
+			Filler<NUM_FLAG_COMBINATIONS - 1>::fill(functions);
+		}
+	};
+
+	void setPulseWidth(T pulseWidth) {
+		const float pwMin = 0.01f;
+		this->pulseWidth = simd::clamp(pulseWidth, pwMin, 1.f - pwMin);
+	}
+
+	/** Dispatches to the process() specialization for the current waves and flags. */
+	void process(float deltaTime, T syncValue) {
+		int flags = waves & WAVE_FLAGS;
+		if (syncEnabled) {
+			flags |= SYNC_FLAG;
+			if (soft)
+				flags |= SOFT_FLAG;
+		}
+
+		static const ProcessFunctions processFunctions;
+		(this->*processFunctions.functions[flags])(deltaTime, syncValue);
+	}
+
+	/** Advances the oscillator with waveforms and modes fixed at compile time by OscillatorFlags. */
+	template <int FLAGS>
+	void process(float deltaTime, T syncValue) {
+		const bool SIN = FLAGS & SIN_FLAG;
+		const bool TRI = FLAGS & TRI_FLAG;
+		const bool SAW = FLAGS & SAW_FLAG;
+		const bool SQR = FLAGS & SQR_FLAG;
+		const bool SOFT = FLAGS & SOFT_FLAG;
+		const bool SYNC = FLAGS & SYNC_FLAG;
+
+		// Discontinuities are only inserted in lanes of active channels
+		T channelMask = simd::movemaskInverse<T>((1 << channels) - 1);
+
+		// Advance phase
+		T deltaPhase = simd::clamp(freq * deltaTime, 0.f, 0.35f);
+		if (SOFT) {
+			// Reverse direction
+			deltaPhase *= syncDirection;
+		}
+		else {
+			// Reset back to forward
+			syncDirection = 1.f;
+		}
+		phase += deltaPhase;
+		// Wrap phase
+		phase -= simd::floor(phase);
+
+		if (SQR) {
+			// Jump sqr when crossing 0, or 1 if backwards
+			T wrapPhase = (syncDirection == -1.f) & 1.f;
+			T wrapCrossing = (wrapPhase - (phase - deltaPhase)) / deltaPhase;
+			T wrap = channelMask & (0 < wrapCrossing) & (wrapCrossing <= 1.f);
+			if (simd::movemask(wrap)) {
+				T x = wrap & (2.f * syncDirection);
+				sqrMinBlep.insertDiscontinuity(wrapCrossing - 1.f, x);
+			}
+
+			// Jump sqr when crossing `pulseWidth`
+			T pulseCrossing = (pulseWidth - (phase - deltaPhase)) / deltaPhase;
+			T pulse = channelMask & (0 < pulseCrossing) & (pulseCrossing <= 1.f);
+			if (simd::movemask(pulse)) {
+				T x = pulse & (-2.f * syncDirection);
+				sqrMinBlep.insertDiscontinuity(pulseCrossing - 1.f, x);
+			}
+		}
+
+		if (SAW) {
+			// Jump saw when crossing 0.5
+			T halfCrossing = (0.5f - (phase - deltaPhase)) / deltaPhase;
+			T half = channelMask & (0 < halfCrossing) & (halfCrossing <= 1.f);
+			if (simd::movemask(half)) {
+				T x = half & (-2.f * syncDirection);
+				sawMinBlep.insertDiscontinuity(halfCrossing - 1.f, x);
+			}
+		}
+
+		// Detect sync
+		// Might be NAN or outside of [0, 1) range
+		if (SYNC) {
+			T deltaSync = syncValue - lastSyncValue;
+			T syncCrossing = -lastSyncValue / deltaSync;
+			lastSyncValue = syncValue;
+			T sync = (0.f < syncCrossing) & (syncCrossing <= 1.f) & (syncValue >= 0.f);
+			int syncMask = simd::movemask(sync);
+			if (syncMask) {
+				if (SOFT) {
+					syncDirection = simd::ifelse(sync, -syncDirection, syncDirection);
+				}
+				else {
+					T newPhase = simd::ifelse(sync, (1.f - syncCrossing) * deltaPhase, phase);
+					// Insert minBLEP for sync
+					T mask = channelMask & sync;
+					T p = syncCrossing - 1.f;
+					if (SQR)
+						sqrMinBlep.insertDiscontinuity(p, mask & (sqr(newPhase) - sqr(phase)));
+					if (SAW)
+						sawMinBlep.insertDiscontinuity(p, mask & (saw(newPhase) - saw(phase)));
+					if (TRI)
+						triMinBlep.insertDiscontinuity(p, mask & (tri(newPhase) - tri(phase)));
+					if (SIN)
+						sinMinBlep.insertDiscontinuity(p, mask & (sin(newPhase) - sin(phase)));
+					phase = newPhase;
+				}
+			}
+		}
+
+		// Square
+		if (SQR) {
+			sqrValue = sqr(phase);
+			sqrValue += sqrMinBlep.process();
+
+			if (analog) {
+				sqrFilter.setCutoffFreq(20.f * deltaTime);
+				sqrFilter.process(sqrValue);
+				sqrValue = sqrFilter.highpass() * 0.95f;
+			}
+		}
+
+		// Saw
+		if (SAW) {
+			sawValue = saw(phase);
+			sawValue += sawMinBlep.process();
+		}
+
+		// Tri
+		if (TRI) {
+			triValue = tri(phase);
+			triValue += triMinBlep.process();
+		}
+
+		// Sin
+		if (SIN) {
+			sinValue = sin(phase);
+			sinValue += sinMinBlep.process();
+		}
+	}
+
+	T sin(T phase) {
+		T v;
+		if (analog) {
+			// Quadratic approximation of sine, slightly richer harmonics
+			T halfPhase = (phase < 0.5f);
+			T x = phase - simd::ifelse(halfPhase, 0.25f, 0.75f);
+			v = 1.f - 16.f * simd::pow(x, 2);
+			v *= simd::ifelse(halfPhase, 1.f, -1.f);
+		}
+		else {
+			v = sin2pi_pade_05_5_4(phase);
+			// v = sin2pi_pade_05_7_6(phase);
+			// v = simd::sin(2 * T(M_PI) * phase);
+		}
+		return v;
+	}
+	T sin() {
+		return sinValue;
+	}
+
+	T tri(T phase) {
+		T v;
+		if (analog) {
+			T x = phase + 0.25f;
+			x -= simd::trunc(x);
+			T halfX = (x >= 0.5f);
+			x *= 2;
+			x -= simd::trunc(x);
+			v = expCurve(x) * simd::ifelse(halfX, 1.f, -1.f);
+		}
+		else {
+			v = 1 - 4 * simd::fmin(simd::fabs(phase - 0.25f), simd::fabs(phase - 1.25f));
+		}
+		return v;
+	}
+	T tri() {
+		return triValue;
+	}
+
+	T saw(T phase) {
+		T v;
+		T x = phase + 0.5f;
+		x -= simd::trunc(x);
+		if (analog) {
+			v = -expCurve(x);
+		}
+		else {
+			v = 2 * x - 1;
+		}
+		return v;
+	}
+	T saw() {
+		return sawValue;
+	}
+
+	T sqr(T phase) {
+		T v = simd::ifelse(phase < pulseWidth, 1.f, -1.f);
+		return v;
+	}
+	T sqr() {
+		return sqrValue;
+	}
+};
+
+
+/** 16 channels of VoltageControlledOscillator, so the SIMD vector width can be selected at runtime.
+Set the per-channel inputs, call process(), and read the per-channel outputs.
+*/
+struct OscillatorBank : Aligned32 {
+	bool analog = false;
+	bool soft = false;
+	bool syncEnabled = false;
+	int waves = WAVE_FLAGS;
+
+	float freq[16] = {};
+	float pulseWidth[16] = {};
+	/** Whether freq or pulseWidth changed since the last process() call.
+	If false, process() skips loading them into the oscillators.
+	*/
+	bool controlsChanged = true;
+	float sync[16] = {};
+
+	float sin[16] = {};
+	float tri[16] = {};
+	float saw[16] = {};
+	float sqr[16] = {};
+
+	virtual ~OscillatorBank() {}
+	virtual void process(int channels, float deltaTime) = 0;
+	/** Returns the phase of the first channel */
+	virtual float getPhase() = 0;
+	/** Sets the phase of every channel to a random value, so stacked unison voices don't start in phase */
+	virtual void randomizePhases() = 0;
+};
+
+
+/** Number of minBLEP quality tiers and oversampling factors accepted by newOscillatorBank() */
+static const int NUM_OSCILLATOR_QUALITIES = 3;
+static const int NUM_OSCILLATOR_OVERSAMPLINGS = 3;
+
+
+/** OscillatorBank running each oscillator at UPSAMPLE times the sample rate and decimating its outputs.
+QUALITY and OVERSAMPLE set the minBLEP length and resolution.
+*/
+template <int QUALITY, int OVERSAMPLE, int UPSAMPLE, typename T>
+struct TOscillatorBank : OscillatorBank {
+	static constexpr int GROUPS = 16 / T::size;
+	VoltageControlledOscillator<OVERSAMPLE, QUALITY, T> oscillators[GROUPS];
+	dsp::Decimator<UPSAMPLE, 8, T> sinDecimators[GROUPS];
+	dsp::Decimator<UPSAMPLE, 8, T> triDecimators[GROUPS];
+	dsp::Decimator<UPSAMPLE, 8, T> sawDecimators[GROUPS];
+	dsp::Decimator<UPSAMPLE, 8, T> sqrDecimators[GROUPS];
+
+	void process(int channels, float deltaTime) override {
+		for (int c = 0; c < channels; c += T::size) {
+			int g = c / T::size;
+			auto& oscillator = oscillators[g];
+			oscillator.channels = std::min(channels - c, int(T::size));
+			oscillator.analog = analog;
+			oscillator.soft = soft;
+			// lastSyncValue isn't updated without sync, so start from the current value instead of faking a crossing from a stale one.
+			if (syncEnabled && !oscillator.syncEnabled)
+				oscillator.lastSyncValue = T::load(&sync[c]);
+			oscillator.syncEnabled = syncEnabled;
+			oscillator.waves = waves;
+			if (controlsChanged) {
+				oscillator.freq = T::load(&freq[c]);
+				oscillator.setPulseWidth(T::load(&pulseWidth[c]));
+			}
+
+			if (UPSAMPLE == 1) {
+				oscillator.process(deltaTime, T::load(&sync[c]));
+
+				if (waves & SIN_FLAG)
+					oscillator.sin().store(&sin[c]);
+				if (waves & TRI_FLAG)
+					oscillator.tri().store(&tri[c]);
+				if (waves & SAW_FLAG)
+					oscillator.saw().store(&saw[c]);
+				if (waves & SQR_FLAG)
+					oscillator.sqr().store(&sqr[c]);
+				continue;
+			}
+
+			// Interpolate sync between frames so crossings keep their subsample position
+			T sync0 = oscillator.lastSyncValue;
+			T syncStep = (T::load(&sync[c]) - sync0) / UPSAMPLE;
+			T sinBuf[UPSAMPLE];
+			T triBuf[UPSAMPLE];
+			T sawBuf[UPSAMPLE];
+			T sqrBuf[UPSAMPLE];
+			for (int i = 0; i < UPSAMPLE; i++) {
+				oscillator.process(deltaTime / UPSAMPLE, sync0 + syncStep * (i + 1));
+				sinBuf[i] = oscillator.sin();
+				triBuf[i] = oscillator.tri();
+				sawBuf[i] = oscillator.saw();
+				sqrBuf[i] = oscillator.sqr();
+			}
+
+			if (waves & SIN_FLAG)
+				sinDecimators[g].process(sinBuf).store(&sin[c]);
+			if (waves & TRI_FLAG)
+				triDecimators[g].process(triBuf).store(&tri[c]);
+			if (waves & SAW_FLAG)
+				sawDecimators[g].process(sawBuf).store(&saw[c]);
+			if (waves & SQR_FLAG)
+				sqrDecimators[g].process(sqrBuf).store(&sqr[c]);
+		}
+	}
+
+	float getPhase() override {
+		return oscillators[0].phase[0];
+	}
+
+	void randomizePhases() override {
+		for (auto& oscillator : oscillators) {
+			for (int i = 0; i < T::size; i++) {
+				oscillator.phase[i] = random::uniform();
+			}
+		}
+	}
+};
+
+
+template <int QUALITY, int OVERSAMPLE, typename T>
+OscillatorBank* newOscillatorBank(int oversampling) {
+	switch (oversampling) {
+		default:
+		case 0: return new TOscillatorBank<QUALITY, OVERSAMPLE, 1, T>;
+		case 1: return new TOscillatorBank<QUALITY, OVERSAMPLE, 2, T>;
+		case 2: return new TOscillatorBank<QUALITY, OVERSAMPLE, 4, T>;
+	}
+}
+
+/** Creates an OscillatorBank with vector type T.
+`quality` selects the minBLEP size: 0 is Eco, 1 is Standard, 2 is High.
+`oversampling` is the log2 of the oversampling factor, up to 4x.
+*/
+template <typename T>
+OscillatorBank* newOscillatorBank(int quality, int oversampling) {
+	switch (quality) {
+		case 0: return newOscillatorBank<8, 8, T>(oversampling);
+		default:
+		case 1: return newOscillatorBank<16, 16, T>(oversampling);
+		case 2: return newOscillatorBank<32, 16, T>(oversampling);
+	}
+}
+
+
+/** Creates an OscillatorBank with the widest SIMD vectors supported by the CPU. */
+OscillatorBank* createOscillatorBank(int quality, int oversampling);
+#if defined AVX2_CORES
+/** Defined in avx2/VCO.cpp, which is compiled with AVX2 and FMA instructions and keeps its inline functions local.
+Only call if hasAvx2() is true.
+*/
+OscillatorBank* createOscillatorBankAvx2(int quality, int oversampling);
+#endif
@@ -105,9 +105,9 @@ struct WTLFO : Module {
 	}
 
 	void onSave(const SaveEvent& e) override {
-		if (!wavetable.samples.empty()) {
+		if (!wavetable.empty()) {
 			std::string path = system::join(createPatchStorageDirectory(), "wavetable.wav");
-			wavetable.save(path);
+			wavetable.saveIfModified(path);
 		}
 	}
 
@@ -138,9 +138,13 @@ struct WTLFO : Module {
 
 		int channels = std::max(1, inputs[FM_INPUT].getChannels());
 
+		// Hold the wavetable data so it isn't deleted while processing
+		Wavetable::Reader reader(wavetable, Wavetable::AUDIO_READER);
+		const WavetableData& data = *reader.data;
+
 		// Check valid wave and wavetable size
-		int waveCount = wavetable.getWaveCount();
-		if (!wavetable.loading && wavetable.waveLen >= 2 && waveCount >= 1) {
+		int waveCount = data.getWaveCount();
+		if (data.waveLen >= 2 && waveCount >= 1) {
 			// Iterate channels
 			for (int c = 0; c < channels; c += 4) {
 				// Calculate frequency in Hz
@@ -158,7 +162,7 @@ struct WTLFO : Module {
 				phase = simd::ifelse(reset, 0.f, phase);
 				phases[c / 4] = phase;
 				// Scale phase from 0 to waveLen
-				phase *= wavetable.waveLen;
+				phase *= data.waveLen;
 
 				// Get wavetable position, scaled from 0 to (waveCount - 1)
 				float_4 pos = posParam + inputs[POS_INPUT].getPolyVoltageSimd<float_4>(c) * posCvParam / 10.f;
@@ -174,15 +178,15 @@ struct WTLFO : Module {
 					// Get wave indexes
 					float phaseF = phase[cc] - std::trunc(phase[cc]);
 					size_t i0 = std::trunc(phase[cc]);
-					size_t i1 = (i0 + 1) % wavetable.waveLen;
+					size_t i1 = (i0 + 1) % data.waveLen;
 					// Get pos indexes
 					float posF = pos[cc] - std::trunc(pos[cc]);
 					size_t pos0 = std::trunc(pos[cc]);
 					size_t pos1 = pos0 + 1;
 					// Get waves
-					float out0 = crossfade(wavetable.at(pos0, i0), wavetable.at(pos0, i1), phaseF);
+					float out0 = crossfade(data.at(pos0, i0), data.at(pos0, i1), phaseF);
 					if (posF > 0.f) {
-						float out1 = crossfade(wavetable.at(pos1, i0), wavetable.at(pos1, i1), phaseF);
+						float out1 = crossfade(data.at(pos1, i0), data.at(pos1, i1), phaseF);
 						out[cc] = crossfade(out0, out1, posF);
 					}
 					else {
@@ -233,6 +237,8 @@ struct WTLFO : Module {
 	}
 
 	json_t* dataToJson() override {
+		// Rack archives the patch storage directory after serializing modules, so finish writing wavetable.wav first.
+		wavetable.waitForSave();
 		json_t* rootJ = json_object();
 		// Merge wavetable
 		json_t* wavetableJ = wavetable.toJson();
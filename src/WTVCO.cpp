@@ -1,5 +1,6 @@
 #include "plugin.hpp"
 #include "Wavetable.hpp"
+#include "MinBlep.hpp"
 
 
 using simd::float_4;
@@ -37,9 +38,11 @@ struct WTVCO : Module {
 	};
 
 	Wavetable wavetable;
+	/** Set from the UI thread and read once per process() call */
+	std::atomic<WavetableData::Kernel> kernel{WavetableData::LINEAR_KERNEL};
 	float_4 phases[4] = {};
 	float lastPos = 0.f;
-	dsp::MinBlepGenerator<16, 16, float_4> syncMinBleps[4];
+	BatchMinBlepGenerator<16, 16, float_4> syncMinBleps[4];
 	float_4 lastSyncValues[4] = {};
 	float_4 syncDirections[4] = {};
 
@@ -69,14 +72,15 @@ struct WTVCO : Module {
 
 		configLight(PHASE_LIGHT, "Phase");
 
-		wavetable.setQuality(8);
-
 		lightDivider.setDivision(16);
 
 		onReset();
 	}
 
 	void onReset() override {
+		// Set the quality first, so reset() bandlimits the basic wavetable only once.
+		wavetable.setQuality(8);
+		kernel.store(WavetableData::LINEAR_KERNEL, std::memory_order_relaxed);
 		wavetable.reset();
 		for (int i = 0; i < 4; i++) {
 			syncDirections[i] = 1.f;
@@ -90,9 +94,9 @@ struct WTVCO : Module {
 	}
 
 	void onSave(const SaveEvent& e) override {
-		if (!wavetable.samples.empty()) {
+		if (!wavetable.empty()) {
 			std::string path = system::join(createPatchStorageDirectory(), "wavetable.wav");
-			wavetable.save(path);
+			wavetable.saveIfModified(path);
 		}
 	}
 
@@ -104,41 +108,6 @@ struct WTVCO : Module {
 		lights[PHASE_LIGHT + 2].setBrightness(0.f);
 	}
 
-	float getWave(float index, float pos, float octave) {
-		// Get wave indexes
-		float indexF = index - std::trunc(index);
-		size_t index0 = std::trunc(index);
-		size_t index1 = (index0 + 1) % (wavetable.waveLen * wavetable.quality);
-		// Get position indexes
-		float posF = pos - std::trunc(pos);
-		size_t pos0 = std::trunc(pos);
-		size_t pos1 = pos0 + 1;
-		// Get octave index
-		// float octaveF = octave - std::trunc(octave);
-		size_t octave0 = std::trunc(octave);
-		octave0 = std::min(octave0, wavetable.octaves - 1);
-		// size_t octave1 = octave0 + 1;
-
-		// Linearly interpolate wave index
-		float out = crossfade(wavetable.interpolatedAt(octave0, pos0, index0), wavetable.interpolatedAt(octave0, pos0, index1), indexF);
-		// Interpolate octave
-		// if (octaveF > 0.f && octave1 < wavetable.octaves) {
-		// 	float out1 = crossfade(wavetable.interpolatedAt(octave1, pos0, index0), wavetable.interpolatedAt(octave1, pos0, index1), indexF);
-		// 	out = crossfade(out, out1, octaveF);
-		// }
-		// Linearly interpolate position if needed
-		if (posF > 0.f) {
-			float out1 = crossfade(wavetable.interpolatedAt(octave0, pos1, index0), wavetable.interpolatedAt(octave0, pos1, index1), indexF);
-			// Interpolate octave
-			// if (octaveF > 0.f && octave1 < wavetable.octaves) {
-			// 	float out2 = crossfade(wavetable.interpolatedAt(octave1, pos1, index0), wavetable.interpolatedAt(octave1, pos1, index1), indexF);
-			// 	out1 = crossfade(out1, out2, octaveF);
-			// }
-			out = crossfade(out, out1, posF);
-		}
-		return out;
-	}
-
 	void process(const ProcessArgs& args) override {
 		float freqParam = params[FREQ_PARAM].getValue() / 12.f;
 		float fmParam = params[FM_PARAM].getValue();
@@ -147,11 +116,16 @@ struct WTVCO : Module {
 		bool soft = params[SOFT_PARAM].getValue() > 0.f;
 		bool linear = params[LINEAR_PARAM].getValue() > 0.f;
 		bool syncEnabled = inputs[SYNC_INPUT].isConnected();
+		WavetableData::Kernel kernel = this->kernel.load(std::memory_order_relaxed);
 
 		int channels = std::max({1, inputs[PITCH_INPUT].getChannels(), inputs[FM_INPUT].getChannels()});
 
-		int waveCount = wavetable.getWaveCount();
-		if (!wavetable.loading && wavetable.waveLen >= 2 && waveCount >= 1) {
+		// Hold the wavetable data so it isn't deleted while processing
+		Wavetable::Reader reader(wavetable, Wavetable::AUDIO_READER);
+		const WavetableData& data = *reader.data;
+
+		int waveCount = data.getWaveCount();
+		if (data.waveLen >= 2 && waveCount >= 1) {
 			// Iterate channels
 			for (int c = 0; c < channels; c += 4) {
 				// Calculate frequency in Hz
@@ -181,7 +155,6 @@ struct WTVCO : Module {
 				// Wrap phase
 				phase -= simd::floor(phase);
 				phases[c / 4] = phase;
-				float_4 index = phase * wavetable.waveLen * wavetable.quality;
 
 				// Get wavetable position, scaled from 0 to (waveCount - 1)
 				float_4 pos = posParam + inputs[POS_INPUT].getPolyVoltageSimd<float_4>(c) * posCvParam / 10.f;
@@ -191,12 +164,7 @@ struct WTVCO : Module {
 				if (c == 0)
 					lastPos = pos[0];
 
-				// Get wave output serially
-				int ccs = std::min(4, channels - c);
-				float_4 out = 0.f;
-				for (int cc = 0; cc < ccs; cc++) {
-					out[cc] = getWave(index[cc], pos[cc], octave[cc]);
-				}
+				float_4 out = data.getWave(phase, pos, octave, kernel);
 
 				// Sync
 				if (syncEnabled) {
@@ -212,17 +180,10 @@ struct WTVCO : Module {
 						}
 						else {
 							phases[c / 4] = simd::ifelse(sync, (1.f - syncCrossing) * deltaPhase, phases[c / 4]);
-							// Insert minBLEP for sync serially
-							for (int cc = 0; cc < ccs; cc++) {
-								if (syncMask & (1 << cc)) {
-									float_4 mask = simd::movemaskInverse<float_4>(1 << cc);
-									float p = syncCrossing[cc] - 1.f;
-									float index = phases[c / 4][cc] * wavetable.waveLen * wavetable.quality;
-									float out1 = getWave(index, pos[cc], octave[cc]);
-									float_4 x = mask & (out1 - out[cc]);
-									syncMinBleps[c / 4].insertDiscontinuity(p, x);
-								}
-							}
+							// Insert minBLEP for sync in active channels
+							float_4 out1 = data.getWave(phases[c / 4], pos, octave, kernel);
+							float_4 mask = simd::movemaskInverse<float_4>((1 << std::min(4, channels - c)) - 1) & sync;
+							syncMinBleps[c / 4].insertDiscontinuity(syncCrossing - 1.f, mask & (out1 - out));
 						}
 					}
 				}
@@ -265,7 +226,13 @@ struct WTVCO : Module {
 	}
 
 	json_t* dataToJson() override {
+		// Rack archives the patch storage directory after serializing modules, so finish writing wavetable.wav first.
+		wavetable.waitForSave();
 		json_t* rootJ = json_object();
+		// quality
+		json_object_set_new(rootJ, "quality", json_integer(wavetable.quality));
+		// kernel
+		json_object_set_new(rootJ, "kernel", json_integer(kernel.load(std::memory_order_relaxed)));
 		// Merge wavetable
 		json_t* wavetableJ = wavetable.toJson();
 		json_object_update(rootJ, wavetableJ);
@@ -274,6 +241,18 @@ struct WTVCO : Module {
 	}
 
 	void dataFromJson(json_t* rootJ) override {
+		// quality
+		json_t* qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ) {
+			// Only the qualities in the menu are supported
+			json_int_t quality = json_integer_value(qualityJ);
+			if (1 <= quality && quality <= (json_int_t) WAVETABLE_MAX_QUALITY && (quality & (quality - 1)) == 0)
+				wavetable.setQuality(quality);
+		}
+		// kernel
+		json_t* kernelJ = json_object_get(rootJ, "kernel");
+		if (kernelJ)
+			kernel.store((WavetableData::Kernel) clamp((int) json_integer_value(kernelJ), 0, WavetableData::NUM_KERNELS - 1), std::memory_order_relaxed);
 		// wavetable
 		wavetable.fromJson(rootJ);
 	}
@@ -319,6 +298,25 @@ struct WTVCOWidget : ModuleWidget {
 		menu->addChild(new MenuSeparator);
 
 		module->wavetable.appendContextMenu(menu);
+
+		// Show the memory used by the bandlimited octaves of the current wavetable at each quality
+		std::vector<std::string> qualityLabels;
+		{
+			Wavetable::Reader reader(module->wavetable, Wavetable::UI_READER);
+			for (int i = 0; i <= 4; i++) {
+				float size = reader->getInterpolatedSize(1 << i) * sizeof(float);
+				qualityLabels.push_back(string::f("%dx (%.1f MB)", 1 << i, size / (1 << 20)));
+			}
+		}
+		menu->addChild(createIndexSubmenuItem("Bandlimiting quality", qualityLabels,
+			[=]() {return math::log2(module->wavetable.quality);},
+			[=](int i) {module->wavetable.setQuality(1 << i);}
+		));
+
+		menu->addChild(createIndexSubmenuItem("Interpolation", {"Linear (2 reads per point)", "Cubic Hermite (4 reads per point)"},
+			[=]() {return module->kernel.load(std::memory_order_relaxed);},
+			[=](int i) {module->kernel.store((WavetableData::Kernel) i, std::memory_order_relaxed);}
+		));
 	}
 };
 
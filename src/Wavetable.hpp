@@ -2,92 +2,573 @@
 #include <rack.hpp>
 #include <osdialog.h>
 #include "dr_wav.h"
+#include "MappedFile.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <thread>
 
 
 static const char WAVETABLE_FILTERS[] = "WAV (.wav):wav,WAV;Raw:f32,i8,i16,i24,i32,*";
 static std::string wavetableDir;
+/** Maximum number of samples of a loaded wavetable.
+Its bandlimited octaves use about `2 * quality` times as much memory.
+*/
+static const size_t WAVETABLE_MAX_LEN = 1 << 22;
+/** Number of samples read from a file at a time while loading */
+static const size_t WAVETABLE_LOAD_CHUNK = 4096;
+/** Version of the layout of WavetableData::interpolatedSamples.
+Increment when interpolate() changes its output, so octaves cached by older versions aren't used.
+*/
+static const uint32_t WAVETABLE_CACHE_VERSION = 2;
 
 
-/** Loads and stores wavetable samples and metadata */
-struct Wavetable {
+/** Highest WavetableData::quality offered by WTVCO */
+static const size_t WAVETABLE_MAX_QUALITY = 16;
+/** Total size of cached octaves above which the least recently used are removed.
+Twice the octaves of the largest wavetable at the highest quality, so the cache can hold it along with others.
+*/
+static const uint64_t WAVETABLE_CACHE_MAX_SIZE = 2 * uint64_t(WAVETABLE_MAX_LEN) * 2 * WAVETABLE_MAX_QUALITY * sizeof(float);
+
+
+/** Directory of bandlimited octaves cached by WavetableData::saveOctaves() */
+inline std::string getWavetableCacheDir() {
+	return asset::user("Fundamental/WavetableCache");
+}
+
+
+/** Removes the least recently used cached octaves until the rest use less than WAVETABLE_CACHE_MAX_SIZE, so the cache doesn't grow forever.
+WavetableData::interpolateCached() touches files when it uses them, so their modification time is their last use.
+Never removes `keepPath`, the file just written, or temporary files, which other threads may be writing or renaming.
+Files still mapped by a WavetableData stay readable on POSIX, and fail to be removed on Windows.
+*/
+inline void pruneWavetableCache(const std::string& keepPath) {
+	struct CacheFile {
+		std::string path;
+		uint64_t size;
+		double time;
+	};
+	std::vector<CacheFile> files;
+	uint64_t size = 0;
+	try {
+		for (const std::string& path : system::getEntries(getWavetableCacheDir())) {
+			if (system::getExtension(path) == ".tmp")
+				continue;
+			CacheFile file;
+			file.path = path;
+			try {
+				file.size = system::getFileSize(path);
+				file.time = system::getFileModifiedTime(path);
+			}
+			catch (Exception& e) {
+				// Removed by another thread since listing the directory
+				continue;
+			}
+			files.push_back(file);
+			size += file.size;
+		}
+	}
+	catch (Exception& e) {
+		WARN("Could not list wavetable cache: %s", e.what());
+		return;
+	}
+	if (size < WAVETABLE_CACHE_MAX_SIZE)
+		return;
+
+	std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+		return a.time < b.time;
+	});
+	for (const CacheFile& file : files) {
+		if (size < WAVETABLE_CACHE_MAX_SIZE)
+			break;
+		if (system::getFilename(file.path) == system::getFilename(keepPath))
+			continue;
+		if (system::remove(file.path))
+			size -= file.size;
+	}
+}
+
+
+/** Returns a vector with `data[offsets[i]]` in lane i.
+SSE has no gather instruction, so lanes are loaded one at a time after computing all offsets at once.
+*/
+inline simd::float_4 gather(const float* data, __m128i offsets) {
+	alignas(16) int32_t o[4];
+	_mm_store_si128((__m128i*) o, offsets);
+	return simd::float_4(data[o[0]], data[o[1]], data[o[2]], data[o[3]]);
+}
+
+
+/** Returns the cubic Hermite (Catmull-Rom) interpolation from y0 to y1 at `t` in [0, 1), with slopes from the points before and after them. */
+template <typename T>
+T cubicHermite(T ym1, T y0, T y1, T y2, T t) {
+	T c1 = 0.5f * (y1 - ym1);
+	T c2 = ym1 - 2.5f * y0 + 2.f * y1 - 0.5f * y2;
+	T c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+	return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+
+/** Returns a RealFFT of `length` shared by all wavetables, created on first use.
+RealFFT doesn't modify its plan when transforming, so several threads can use it at once.
+*/
+inline dsp::RealFFT* getWavetableFFT(size_t length) {
+	static std::mutex mutex;
+	static std::map<size_t, std::unique_ptr<dsp::RealFFT>> ffts;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<dsp::RealFFT>& fft = ffts[length];
+	if (!fft)
+		fft.reset(new dsp::RealFFT(length));
+	return fft.get();
+}
+
+
+/** Returns the number of threads in the WavetableThreadPool.
+Leaves a core for the engine, since interpolating usually happens while audio is running.
+*/
+inline int getWavetableThreadCount() {
+	return std::max(1, system::getLogicalCoreCount() - 1);
+}
+
+
+/** Aligned memory owned by a WavetableThreadPool thread and reused by every batch it runs */
+struct WavetableScratch {
+	float* buffer = NULL;
+	size_t size = 0;
+
+	~WavetableScratch() {
+		pffft_aligned_free(buffer);
+	}
+
+	/** Returns at least `size` floats aligned for pffft, valid until the next call. */
+	float* get(size_t size) {
+		if (size > this->size) {
+			pffft_aligned_free(buffer);
+			buffer = (float*) pffft_aligned_malloc(size * sizeof(float));
+			this->size = size;
+		}
+		return buffer;
+	}
+};
+
+
+/** Threads shared by all WavetableData::interpolate() calls, so bandlimiting doesn't create threads.
+Started by the first user and stopped by the last one, which is a Wavetable destroyed on the UI thread.
+The threads are never joined by the static pool's destructor, which runs under the loader lock on Windows, where joining them could deadlock.
+*/
+struct WavetableThreadPool {
+	/** Function run by several threads at once with each thread's scratch memory, each returning when no work is left */
+	struct Batch {
+		const std::function<void(WavetableScratch&)>* work;
+		/** Number of threads that haven't returned from `work` */
+		size_t pending;
+	};
+
+	std::mutex mutex;
+	/** Notified when a batch is queued or the pool is stopping */
+	std::condition_variable queued;
+	/** Notified when a thread returns from a batch */
+	std::condition_variable finished;
+	/** A batch appears once for each thread that should run it */
+	std::deque<Batch*> queue;
+	std::vector<std::thread> threads;
+	bool stopping = false;
+
+	/** Held while starting or stopping the threads */
+	std::mutex usersMutex;
+	/** Number of addUser() calls not yet matched by removeUser() */
+	size_t users = 0;
+
+	~WavetableThreadPool() {
+		// Threads are only left if a Wavetable was never destroyed. Joining them here could deadlock, so they end with the process.
+		for (std::thread& thread : threads) {
+			thread.detach();
+		}
+	}
+
+	/** Starts the threads if the pool has no users. */
+	void addUser() {
+		std::lock_guard<std::mutex> usersLock(usersMutex);
+		if (users++ > 0)
+			return;
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = false;
+		int threadCount = getWavetableThreadCount();
+		for (int t = 0; t < threadCount; t++) {
+			threads.emplace_back([this]() {runThread();});
+		}
+	}
+
+	/** Stops and joins the threads when the last user is removed.
+	Waits for running batches, so don't call it while holding a lock that run()'s caller needs.
+	*/
+	void removeUser() {
+		std::lock_guard<std::mutex> usersLock(usersMutex);
+		if (--users > 0)
+			return;
+		std::vector<std::thread> stoppedThreads;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			stoppedThreads = std::move(threads);
+			threads.clear();
+		}
+		queued.notify_all();
+		for (std::thread& thread : stoppedThreads) {
+			thread.join();
+		}
+	}
+
+	/** Runs batches until the pool is stopping and the queue is empty. */
+	void runThread() {
+		WavetableScratch scratch;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			queued.wait(lock, [&]() {return stopping || !queue.empty();});
+			if (queue.empty())
+				return;
+			Batch* batch = queue.front();
+			queue.pop_front();
+			lock.unlock();
+			(*batch->work)(scratch);
+			lock.lock();
+			batch->pending--;
+			finished.notify_all();
+		}
+	}
+
+	/** Runs `work` on up to `threadCount` pool threads at once, and waits until all of them have returned.
+	If the pool has no users, runs `work` on this thread instead.
+	Must not be called from `work`.
+	*/
+	void run(const std::function<void(WavetableScratch&)>& work, size_t threadCount) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (threads.empty()) {
+			lock.unlock();
+			WavetableScratch scratch;
+			work(scratch);
+			return;
+		}
+		Batch batch;
+		batch.work = &work;
+		batch.pending = std::min(threadCount, threads.size());
+		for (size_t t = 0; t < batch.pending; t++) {
+			queue.push_back(&batch);
+		}
+		queued.notify_all();
+		finished.wait(lock, [&]() {return batch.pending == 0;});
+	}
+
+	static WavetableThreadPool& get() {
+		static WavetableThreadPool pool;
+		return pool;
+	}
+};
+
+
+/** Array of floats stored in a vector, or read-only in a MappedFile which it keeps open.
+Copies share the vector or map, so copying a WavetableData doesn't copy its samples.
+Writing to an array through data() or resize() first gives it its own copy of a shared vector.
+*/
+struct FloatArray {
+	std::shared_ptr<std::vector<float>> vector;
+	std::shared_ptr<MappedFile> file;
+	const float* mappedData = NULL;
+	size_t mappedSize = 0;
+
+	FloatArray() {}
+	FloatArray(std::vector<float>&& vector) : vector(std::make_shared<std::vector<float>>(std::move(vector))) {}
+	FloatArray(std::shared_ptr<std::vector<float>> vector) : vector(vector) {}
+
+	/** Only valid if not mapped */
+	float* data() {
+		unshare();
+		return vector ? vector->data() : NULL;
+	}
+	const float* data() const {
+		if (file)
+			return mappedData;
+		return vector ? vector->data() : NULL;
+	}
+	size_t size() const {
+		if (file)
+			return mappedSize;
+		return vector ? vector->size() : 0;
+	}
+	bool empty() const {
+		return size() == 0;
+	}
+	float operator[](size_t i) const {
+		return data()[i];
+	}
+	bool operator==(const FloatArray& other) const {
+		if (size() != other.size())
+			return false;
+		return data() == other.data() || std::equal(data(), data() + size(), other.data());
+	}
+
+	void clear() {
+		file = NULL;
+		mappedData = NULL;
+		mappedSize = 0;
+		vector = NULL;
+	}
+	void resize(size_t size) {
+		if (file)
+			clear();
+		unshare();
+		if (!vector)
+			vector = std::make_shared<std::vector<float>>();
+		vector->resize(size);
+	}
+	/** Uses `size` floats starting at byte `offset` of `file` instead of the vector. */
+	void map(std::shared_ptr<MappedFile> file, size_t offset, size_t size) {
+		vector = NULL;
+		this->file = file;
+		mappedData = (const float*) (file->data + offset);
+		mappedSize = size;
+	}
+	/** Copies the vector if other arrays share it.
+	Only this array's thread can add owners, so the vector can't become shared after the check.
+	Vectors registered with WavetableRegistry::addSamples() can gain owners on any thread, but are never written.
+	*/
+	void unshare() {
+		if (vector && vector.use_count() > 1)
+			vector = std::make_shared<std::vector<float>>(*vector);
+	}
+};
+
+
+/** Header of a file in the wavetable cache, followed by WavetableData::interpolatedSamples.
+Padded to 64 bytes so the floats are aligned when the file is mapped.
+*/
+struct WavetableCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint64_t waveLen;
+	uint64_t quality;
+	uint64_t octaves;
+	/** Number of floats after the header */
+	uint64_t size;
+	uint8_t padding[16];
+};
+
+static_assert(sizeof(WavetableCacheHeader) == 64, "WavetableCacheHeader must be 64 bytes");
+
+
+/** Wavetable samples and their bandlimited octaves.
+Never modified after Wavetable publishes it, so the audio thread can read it without locking, and several Wavetables can share it.
+*/
+struct WavetableData {
+	/** Interpolation between the points of a bandlimited wave */
+	enum Kernel {
+		LINEAR_KERNEL,
+		CUBIC_KERNEL,
+		NUM_KERNELS
+	};
+
 	/** All waves concatenated
 	(waveCount, waveLen)
 	*/
-	std::vector<float> samples;
+	FloatArray samples;
 	/** Number of points in each wave */
 	size_t waveLen = 0;
-	/** Name of loaded wavetable. */
-	std::string filename;
 
 	// Interpolated wavetables
 	/** Upsampling factor. No upsampling if 0. */
 	size_t quality = 0;
 	/** Number of filtered wavetables. Automatically computed from waveLen. */
 	size_t octaves = 0;
-	/** Waves bandlimited at each octave
-	(octave, waveCount, waveLen * quality)
+	/** Waves bandlimited at each octave, where octave k keeps 2^k harmonics and has getMipLen(k) points per wave
+	(octave, waveCount, getMipLen(octave))
+	About `2 * quality` floats per sample, half of them in the top octave.
+	That is `(log2(waveLen) - 1) / 2` times less than storing every octave at full length, 3.5x for 256-point waves and 5x for 2048-point waves.
 	*/
-	std::vector<float> interpolatedSamples;
+	FloatArray interpolatedSamples;
+	/** getSamplesHash(), set when publishing, so saving and getHash() don't read the samples again */
+	uint64_t samplesHash = 0;
 
-	bool loading = false;
-
-	Wavetable() {}
-
-	float &at(size_t waveIndex, size_t sampleIndex) {
-		return samples[waveLen * waveIndex + sampleIndex];
-	}
 	float at(size_t waveIndex, size_t sampleIndex) const {
 		return samples[waveLen * waveIndex + sampleIndex];
 	}
-	float interpolatedAt(size_t octave, size_t waveIndex, size_t sampleIndex) const {
-		return interpolatedSamples[samples.size() * quality * octave + waveLen * quality * waveIndex + sampleIndex];
+	/** Returns the number of points in each wave of an octave.
+	Every octave has `4 * quality` points per period of its highest harmonic, so the length halves with each lower octave.
+	*/
+	size_t getMipLen(size_t octave) const {
+		return (4 * quality) << octave;
+	}
+	/** Returns the first point of a wave bandlimited at an octave. */
+	const float* getMip(size_t octave, size_t waveIndex) const {
+		// Octaves before this one have a total of `getMipLen(octave) - getMipLen(0)` points per wave.
+		size_t octaveOffset = getWaveCount() * (getMipLen(octave) - getMipLen(0));
+		return interpolatedSamples.data() + octaveOffset + getMipLen(octave) * waveIndex;
+	}
+	float* getMip(size_t octave, size_t waveIndex) {
+		return const_cast<float*>(const_cast<const WavetableData*>(this)->getMip(octave, waveIndex));
 	}
 
-	void reset() {
-		filename = "Basic.wav";
-		waveLen = 1024;
-		loading = true;
-		DEFER({loading = false;});
-		// HACK Sleep 100us so DSP thread is likely to finish processing before we resize the vector
-		std::this_thread::sleep_for(std::chrono::duration<double>(100e-6));
-		samples.resize(waveLen * 4);
+	/** Returns a wave bandlimited at an octave, interpolated with `kernel` at `phase` in [0, 1). */
+	float mipAt(size_t octave, size_t waveIndex, float phase, Kernel kernel = LINEAR_KERNEL) const {
+		size_t len = getMipLen(octave);
+		const float* mip = getMip(octave, waveIndex);
+		float index = phase * len;
+		float indexF = index - std::trunc(index);
+		size_t index0 = std::trunc(index);
+		size_t index1 = (index0 + 1) % len;
+		if (kernel == CUBIC_KERNEL)
+			return cubicHermite(mip[(index0 + len - 1) % len], mip[index0], mip[index1], mip[(index0 + 2) % len], indexF);
+		return crossfade(mip[index0], mip[index1], indexF);
+	}
 
-		// Sine
-		for (size_t i = 0; i < waveLen; i++) {
-			float p = float(i) / waveLen;
-			at(0, i) = std::sin(2 * float(M_PI) * p);
+	/** Returns the interpolated wave at `phase` in [0, 1), fractional wave position `pos`, and fractional octave `octave`.
+	`octave` is log2 of the Nyquist frequency divided by the wave frequency.
+	*/
+	float getWave(float phase, float pos, float octave, Kernel kernel = LINEAR_KERNEL) const {
+		// Get position indexes
+		float posF = pos - std::trunc(pos);
+		size_t pos0 = std::trunc(pos);
+		size_t pos1 = pos0 + 1;
+		// Octave k is below Nyquist when k <= octave, so crossfade from floor(octave) - 1 to floor(octave).
+		// Clamp before converting to an integer, which is undefined for the infinite octave at 0 Hz. fmax() returns 0 for NAN.
+		octave = std::fmin(std::fmax(octave - 1.f, 0.f), float(octaves - 1));
+		// Get octave indexes
+		float octaveF = octave - std::trunc(octave);
+		size_t octave0 = std::trunc(octave);
+		size_t octave1 = octave0 + 1;
+
+		float out = mipAt(octave0, pos0, phase, kernel);
+		// Interpolate octave
+		if (octaveF > 0.f && octave1 < octaves) {
+			float out1 = mipAt(octave1, pos0, phase, kernel);
+			out = crossfade(out, out1, octaveF);
 		}
-		// Triangle
-		for (size_t i = 0; i < waveLen; i++) {
-			float p = float(i) / waveLen;
-			at(1, i) = (p < 0.25f) ? 4*p : (p < 0.75f) ? 2 - 4*p : 4*p - 4;
+		// Linearly interpolate position if needed
+		if (posF > 0.f) {
+			float out1 = mipAt(octave0, pos1, phase, kernel);
+			// Interpolate octave
+			if (octaveF > 0.f && octave1 < octaves) {
+				float out2 = mipAt(octave1, pos1, phase, kernel);
+				out1 = crossfade(out1, out2, octaveF);
+			}
+			out = crossfade(out, out1, posF);
 		}
-		// Sawtooth
-		for (size_t i = 0; i < waveLen; i++) {
-			float p = float(i) / waveLen;
-			at(2, i) = (p < 0.5f) ? 2*p : 2*p - 2;
+		return out;
+	}
+
+	/** getWave() for 4 channels at once.
+	Until interpolate() has finished, reads the samples without bandlimiting.
+	*/
+	simd::float_4 getWave(simd::float_4 phase, simd::float_4 pos, simd::float_4 octave, Kernel kernel = LINEAR_KERNEL) const {
+		using simd::float_4;
+		if (interpolatedSamples.empty())
+			return getRawWave(phase, pos);
+
+		// Get position indexes
+		float_4 pos0 = simd::trunc(pos);
+		float_4 posF = pos - pos0;
+		// Read the same wave if posF is 0, since pos0 may be the last wave
+		float_4 pos1 = simd::ifelse(posF > 0.f, pos0 + 1.f, pos0);
+		// Octave k is below Nyquist when k <= octave, so crossfade from floor(octave) - 1 to floor(octave).
+		// fmax() returns 0 for NAN.
+		octave = simd::fmax(octave - 1.f, 0.f);
+		// Get octave indexes
+		float_4 octave0 = simd::fmax(simd::fmin(simd::trunc(octave), float(octaves - 1)), 0.f);
+		// Crossfade to the next octave unless octave0 is the last, in which case octaveF is 0
+		float_4 octaveF = octave - simd::trunc(octave);
+		octaveF = (octave0 < float(octaves - 1)) & (octaveF > 0.f) & octaveF;
+		float_4 octave1 = simd::ifelse(octaveF > 0.f, octave0 + 1.f, octave0);
+
+		const float* data = interpolatedSamples.data();
+		__m128i len0 = _mm_set1_epi32(getMipLen(0));
+		__m128i waveCount = _mm_set1_epi32(getWaveCount());
+
+		// Same as mipAt() with a different octave and wave in each lane
+		auto lookup = [&](float_4 octaveK, float_4 posK) {
+			// getMipLen(octaveK). SSE can't shift each lane by a different amount, so compute 2^octaveK from float exponent bits.
+			__m128i octavePow = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(octaveK.v), _mm_set1_epi32(127)), 23)));
+			__m128i len = _mm_mullo_epi32(len0, octavePow);
+			__m128i offset = _mm_mullo_epi32(waveCount, _mm_sub_epi32(len, len0));
+			offset = _mm_add_epi32(offset, _mm_mullo_epi32(len, _mm_cvttps_epi32(posK.v)));
+
+			float_4 lenF = _mm_cvtepi32_ps(len);
+			float_4 index = phase * lenF;
+			float_4 indexF = index - simd::trunc(index);
+			// Keep indexes in range if `index` rounded up to `len`
+			float_4 index0 = simd::fmax(simd::trunc(index), 0.f);
+			index0 = simd::ifelse(index0 >= lenF, 0.f, index0);
+			float_4 index1 = index0 + 1.f;
+			index1 = simd::ifelse(index1 >= lenF, 0.f, index1);
+
+			float_4 y0 = gather(data, _mm_add_epi32(offset, _mm_cvttps_epi32(index0.v)));
+			float_4 y1 = gather(data, _mm_add_epi32(offset, _mm_cvttps_epi32(index1.v)));
+			if (kernel != CUBIC_KERNEL)
+				return crossfade(y0, y1, indexF);
+
+			float_4 indexM1 = simd::ifelse(index0 < 1.f, lenF - 1.f, index0 - 1.f);
+			float_4 index2 = index1 + 1.f;
+			index2 = simd::ifelse(index2 >= lenF, 0.f, index2);
+			float_4 ym1 = gather(data, _mm_add_epi32(offset, _mm_cvttps_epi32(indexM1.v)));
+			float_4 y2 = gather(data, _mm_add_epi32(offset, _mm_cvttps_epi32(index2.v)));
+			return cubicHermite(ym1, y0, y1, y2, indexF);
+		};
+
+		bool interpolateOctave = simd::movemask(octaveF > 0.f);
+		float_4 out = lookup(octave0, pos0);
+		// Interpolate octave
+		if (interpolateOctave) {
+			float_4 out1 = lookup(octave1, pos0);
+			out = crossfade(out, out1, octaveF);
 		}
-		// Square
-		for (size_t i = 0; i < waveLen; i++) {
-			float p = float(i) / waveLen;
-			at(3, i) = (p < 0.5f) ? 1 : -1;
+		// Linearly interpolate position if needed
+		if (simd::movemask(posF > 0.f)) {
+			float_4 out1 = lookup(octave0, pos1);
+			// Interpolate octave
+			if (interpolateOctave) {
+				float_4 out2 = lookup(octave1, pos1);
+				out1 = crossfade(out1, out2, octaveF);
+			}
+			out = crossfade(out, out1, posF);
 		}
-		interpolate();
+		return out;
 	}
 
-	void setQuality(size_t quality) {
-		if (quality == this->quality)
-			return;
-		this->quality = quality;
-		interpolate();
+	/** Returns the samples at `phase` in [0, 1) and fractional wave position `pos` for 4 channels, linearly interpolated. */
+	simd::float_4 getRawWave(simd::float_4 phase, simd::float_4 pos) const {
+		using simd::float_4;
+		// Get position indexes
+		float_4 pos0 = simd::trunc(pos);
+		float_4 posF = pos - pos0;
+		float_4 pos1 = simd::ifelse(posF > 0.f, pos0 + 1.f, pos0);
+
+		float_4 lenF = float(waveLen);
+		float_4 index = phase * lenF;
+		float_4 indexF = index - simd::trunc(index);
+		float_4 index0 = simd::fmax(simd::trunc(index), 0.f);
+		index0 = simd::ifelse(index0 >= lenF, 0.f, index0);
+		float_4 index1 = index0 + 1.f;
+		index1 = simd::ifelse(index1 >= lenF, 0.f, index1);
+		__m128i i0 = _mm_cvttps_epi32(index0.v);
+		__m128i i1 = _mm_cvttps_epi32(index1.v);
+
+		__m128i len = _mm_set1_epi32(waveLen);
+		__m128i offset0 = _mm_mullo_epi32(len, _mm_cvttps_epi32(pos0.v));
+		__m128i offset1 = _mm_mullo_epi32(len, _mm_cvttps_epi32(pos1.v));
+		const float* data = samples.data();
+		float_4 out0 = crossfade(gather(data, _mm_add_epi32(offset0, i0)), gather(data, _mm_add_epi32(offset0, i1)), indexF);
+		float_4 out1 = crossfade(gather(data, _mm_add_epi32(offset1, i0)), gather(data, _mm_add_epi32(offset1, i1)), indexF);
+		return crossfade(out0, out1, posF);
 	}
 
-	void setWaveLen(size_t waveLen) {
-		if (waveLen == this->waveLen)
-			return;
-		this->waveLen = waveLen;
-		interpolate();
+	/** Returns the number of floats interpolate() would compute at `quality`. */
+	size_t getInterpolatedSize(size_t quality) const {
+		if (quality == 0 || waveLen < 4)
+			return 0;
+		size_t octaves = math::log2(waveLen) - 1;
+		return getWaveCount() * (((4 * quality) << octaves) - 4 * quality);
 	}
 
 	/** Returns the number of waves in the wavetable. */
@@ -97,48 +578,584 @@ struct Wavetable {
 		return samples.size() / waveLen;
 	}
 
-	void interpolate() {
+	/** Computes the bandlimited octaves from the samples.
+	Sets `progress` to the fraction of waves computed so far.
+	Stops early and returns false when `cancel` is set.
+	*/
+	bool interpolate(std::atomic<float>* progress = NULL, const std::atomic<bool>* cancel = NULL) {
 		if (quality == 0)
-			return;
-		if (waveLen < 2)
-			return;
+			return true;
+		// Shorter waves have no octaves, so they are played without bandlimiting.
+		if (waveLen < 4)
+			return true;
 
 		size_t waveCount = getWaveCount();
 		if (waveCount == 0)
-			return;
+			return true;
 
 		octaves = math::log2(waveLen) - 1;
 		interpolatedSamples.clear();
-		interpolatedSamples.resize(octaves * samples.size() * quality);
+		interpolatedSamples.resize(waveCount * (getMipLen(octaves) - getMipLen(0)));
 
-		float* in = new float[waveLen];
-		float* inF = new float[2 * waveLen];
-		dsp::RealFFT inFFT(waveLen);
+		// pffft's real FFT needs a multiple of 32 points, so shorter waves are repeated, which moves harmonic j to bin `j * repeats`.
+		size_t inLen = std::max(waveLen, (size_t) 32);
+		size_t repeats = inLen / waveLen;
+		dsp::RealFFT* inFFT = getWavetableFFT(inLen);
 
-		float* outF = new float[2 * waveLen * quality]();
-		dsp::RealFFT outFFT(waveLen * quality);
+		// Mips shorter than 32 points are computed with 32 points and decimated, which is exact since they have no harmonics above their Nyquist frequency.
+		std::vector<size_t> outLens;
+		std::vector<dsp::RealFFT*> outFFTs;
+		for (size_t octave = 0; octave < octaves; octave++) {
+			outLens.push_back(std::max(getMipLen(octave), (size_t) 32));
+			outFFTs.push_back(getWavetableFFT(outLens[octave]));
+		}
+		size_t maxLen = outLens[octaves - 1];
 
-		for (size_t i = 0; i < waveCount; i++) {
-			// Compute FFT of wave
-			for (size_t j = 0; j < waveLen; j++) {
-				in[j] = samples[waveLen * i + j] / waveLen;
-			}
-			inFFT.rfft(in, inF);
-			// Compute FFT-filtered versions of each wave
-			for (size_t octave = 0; octave < octaves; octave++) {
-				size_t bins = 1 << octave;
-				// Only overwrite the first waveLen bins
-				for (size_t j = 0; j < waveLen; j++) {
-					outF[2 * j + 0] = (j <= bins) ? inF[2 * j + 0] : 0.f;
-					outF[2 * j + 1] = (j <= bins) ? inF[2 * j + 1] : 0.f;
+		// Waves are independent and write to different mips, so pool threads take the next wave until none are left.
+		std::atomic<size_t> nextWave(0);
+		std::atomic<size_t> wavesDone(0);
+		std::atomic<bool> cancelled(false);
+		std::function<void(WavetableScratch&)> work = [&](WavetableScratch& scratch) {
+			float* in = scratch.get(2 * inLen + 2 * maxLen + std::max(inLen, maxLen));
+			float* inF = in + inLen;
+			float* outF = inF + inLen;
+			float* out = outF + maxLen;
+			// RealFFT gives pffft no work memory, so pffft would put an array as long as the transform on the stack.
+			// Pool threads have the default stack size, which is only 512 KB on macOS, so pass heap memory to pffft directly.
+			float* fftWork = out + maxLen;
+
+			while (true) {
+				if (cancel && *cancel) {
+					cancelled = true;
+					break;
+				}
+				size_t i = nextWave++;
+				if (i >= waveCount)
+					break;
+
+				// Compute FFT of wave
+				for (size_t j = 0; j < inLen; j++) {
+					in[j] = samples[waveLen * i + j % waveLen] / inLen;
 				}
-				outFFT.irfft(outF, &interpolatedSamples[samples.size() * quality * octave + waveLen * quality * i]);
+				pffft_transform_ordered(inFFT->setup, in, inF, fftWork, PFFFT_FORWARD);
+				// Compute FFT-filtered versions of each wave
+				for (size_t octave = 0; octave < octaves; octave++) {
+					size_t bins = 1 << octave;
+					size_t len = getMipLen(octave);
+					size_t outLen = outLens[octave];
+					for (size_t j = 0; j < outLen / 2; j++) {
+						outF[2 * j + 0] = (j <= bins) ? inF[2 * j * repeats + 0] : 0.f;
+						outF[2 * j + 1] = (j <= bins) ? inF[2 * j * repeats + 1] : 0.f;
+					}
+					// The imaginary part of DC holds the Nyquist bin, which is always filtered out
+					outF[1] = 0.f;
+					float* mip = getMip(octave, i);
+					if (outLen == len) {
+						pffft_transform_ordered(outFFTs[octave]->setup, outF, mip, fftWork, PFFFT_BACKWARD);
+					}
+					else {
+						pffft_transform_ordered(outFFTs[octave]->setup, outF, out, fftWork, PFFFT_BACKWARD);
+						size_t step = outLen / len;
+						for (size_t j = 0; j < len; j++) {
+							mip[j] = out[j * step];
+						}
+					}
+				}
+
+				// Wavetable sets progress to 1 after publishing the data.
+				size_t done = ++wavesDone;
+				if (progress && done < waveCount)
+					*progress = float(done) / waveCount;
 			}
+		};
+
+		WavetableThreadPool::get().run(work, waveCount);
+		return !cancelled;
+	}
+
+	/** Returns whether `other` has the same samples, waveLen and quality, so it has the same bandlimited octaves. */
+	bool hasSameSamples(const WavetableData& other) const {
+		return waveLen == other.waveLen && quality == other.quality && samples == other.samples;
+	}
+
+	/** Returns a hash of the samples and everything else the bandlimited octaves depend on.
+	Combines samplesHash with the quality, so it doesn't read the samples.
+	*/
+	uint64_t getHash() const {
+		uint64_t hash = mixHash(samplesHash, WAVETABLE_CACHE_VERSION);
+		return mixHash(hash, quality);
+	}
+
+	/** Returns a hash of everything Wavetable::save() writes. */
+	uint64_t getSamplesHash() const {
+		return getSamplesHash(samples, waveLen);
+	}
+
+	/** Hashes 8 bytes at a time in 4 independent lanes, so the multiplications of different lanes overlap. */
+	static uint64_t getSamplesHash(const FloatArray& samples, size_t waveLen) {
+		const float* data = samples.data();
+		size_t size = samples.size();
+		uint64_t lanes[4] = {0x243f6a8885a308d3, 0x13198a2e03707344, 0xa4093822299f31d0, 0x082efa98ec4e6c89};
+		lanes[0] = mixHash(lanes[0], waveLen);
+		lanes[1] = mixHash(lanes[1], size);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			for (int l = 0; l < 4; l++) {
+				uint64_t word;
+				std::memcpy(&word, &data[i + 2 * l], sizeof(word));
+				lanes[l] = mixHash(lanes[l], word);
+			}
+		}
+		for (; i < size; i++) {
+			uint32_t word;
+			std::memcpy(&word, &data[i], sizeof(word));
+			lanes[0] = mixHash(lanes[0], word);
 		}
 
-		delete[] in;
-		delete[] inF;
-		delete[] outF;
+		uint64_t hash = lanes[0];
+		for (int l = 1; l < 4; l++) {
+			hash = mixHash(hash, lanes[l]);
+		}
+		return hash;
+	}
+
+	/** Adds a word to a hash. The shift carries the high bits of the product down, so every bit of the word reaches every bit of later hashes. */
+	static uint64_t mixHash(uint64_t hash, uint64_t word) {
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+		return hash ^ (hash >> 32);
+	}
+
+	/** Maps the bandlimited octaves from a file written by saveOctaves().
+	Returns false if the file doesn't exist, was written for different data, or `cancel` was set while loading it.
+	*/
+	bool loadOctaves(const std::string& path, uint64_t hash, const std::atomic<bool>* cancel = NULL) {
+		std::shared_ptr<MappedFile> file = MappedFile::open(path);
+		if (!file || file->size < sizeof(WavetableCacheHeader))
+			return false;
+
+		WavetableCacheHeader header;
+		std::memcpy(&header, file->data, sizeof(header));
+		size_t octaves = math::log2(waveLen) - 1;
+		if (std::memcmp(header.magic, "FWTC", 4) != 0 || header.version != WAVETABLE_CACHE_VERSION)
+			return false;
+		if (header.hash != hash || header.waveLen != waveLen || header.quality != quality || header.octaves != octaves)
+			return false;
+		size_t size = getWaveCount() * (getMipLen(octaves) - getMipLen(0));
+		if (header.size != size || file->size != sizeof(header) + size * sizeof(float))
+			return false;
+
+		// The audio thread reads the octaves, so load their pages on this thread instead of faulting on first read.
+		// Cache files are only written by saveOctaves() and replaced by renaming, so the map never changes under the audio thread.
+		if (!file->prefault(cancel))
+			return false;
+		this->octaves = octaves;
+		interpolatedSamples.map(file, sizeof(header), size);
+		return true;
+	}
+
+	/** Writes the bandlimited octaves to a temporary file and renames it to `path`, so other threads never map a partial file.
+	Writes a chunk at a time, and stops and removes the temporary file when `cancel` is set.
+	*/
+	void saveOctaves(const std::string& path, uint64_t hash, const std::atomic<bool>* cancel = NULL) const {
+		size_t size = interpolatedSamples.size();
+		WavetableCacheHeader header = {};
+		std::memcpy(header.magic, "FWTC", 4);
+		header.version = WAVETABLE_CACHE_VERSION;
+		header.hash = hash;
+		header.waveLen = waveLen;
+		header.quality = quality;
+		header.octaves = octaves;
+		header.size = size;
+
+		std::string tmpPath = path + string::f(".%08x.tmp", random::u32());
+		FILE* file = fopen(tmpPath.c_str(), "wb");
+		if (!file)
+			return;
+		bool written = (fwrite(&header, sizeof(header), 1, file) == 1);
+		const size_t chunkSize = 1 << 20;
+		for (size_t pos = 0; written && pos < size; pos += chunkSize) {
+			if (cancel && *cancel) {
+				written = false;
+				break;
+			}
+			size_t n = std::min(size - pos, chunkSize);
+			written = (fwrite(interpolatedSamples.data() + pos, sizeof(float), n, file) == n);
+		}
+		written = (fclose(file) == 0) && written;
+		// If another instance already wrote the same file, renaming fails on some platforms, which is fine.
+		if (!written || !system::rename(tmpPath, path))
+			system::remove(tmpPath);
+	}
+
+	/** Maps the bandlimited octaves from the cache, or computes them with interpolate() and adds them to the cache.
+	`hash` must be getHash().
+	Returns false if `cancel` was set before the octaves were ready.
+	*/
+	bool interpolateCached(uint64_t hash, std::atomic<float>* progress = NULL, const std::atomic<bool>* cancel = NULL) {
+		if (quality == 0 || waveLen < 4 || getWaveCount() == 0)
+			return true;
+
+		std::string dir = getWavetableCacheDir();
+		std::string path = system::join(dir, string::f("%016llx.bin", (unsigned long long) hash));
+		if (loadOctaves(path, hash, cancel)) {
+			// Mark the file as recently used, so pruning removes octaves that haven't been used for longer first.
+			touchFile(path);
+			return true;
+		}
+
+		// The UI thread waits for this thread when it cancels, so check between each slow step.
+		if (cancel && *cancel)
+			return false;
+		if (!interpolate(progress, cancel))
+			return false;
+		system::createDirectories(dir);
+		saveOctaves(path, hash, cancel);
+		if (cancel && *cancel)
+			return false;
+		pruneWavetableCache(path);
+		return true;
+	}
+};
+
+
+/** Samples and bandlimited WavetableData shared by all Wavetables that load the same samples.
+Samples are shared at every quality, so WTLFO and WTVCO loading the same file share them.
+Bandlimited data is shared by Wavetables with the same samples, waveLen and quality.
+Holds weak references, so data is deleted when no Wavetable uses it.
+Candidates are compared outside the mutex, since comparing samples may read all of them.
+*/
+struct WavetableRegistry {
+	std::mutex mutex;
+	/** Sample vectors keyed by WavetableData::getSamplesHash() */
+	std::map<uint64_t, std::weak_ptr<std::vector<float>>> samples;
+	/** Bandlimited data keyed by WavetableData::getHash() */
+	std::map<uint64_t, std::weak_ptr<const WavetableData>> entries;
+
+	/** Returns registered samples equal to `samples`, or registers `samples` and returns them.
+	Registered vectors must never be modified, since any thread can share them.
+	*/
+	FloatArray addSamples(const FloatArray& samples, uint64_t samplesHash) {
+		// Mapped files are shared through the OS page cache instead.
+		if (!samples.vector)
+			return samples;
+
+		std::shared_ptr<std::vector<float>> entry;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = this->samples.find(samplesHash);
+			if (it != this->samples.end())
+				entry = it->second.lock();
+		}
+		if (entry && (entry == samples.vector || *entry == *samples.vector))
+			return FloatArray(entry);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		removeExpired();
+		std::weak_ptr<std::vector<float>>& registered = this->samples[samplesHash];
+		// Different samples with the same hash aren't shared.
+		if (registered.expired())
+			registered = samples.vector;
+		return samples;
+	}
+
+	/** Returns registered data with the same samples, waveLen and quality as `data`, or NULL. */
+	std::shared_ptr<const WavetableData> find(const WavetableData& data, uint64_t hash) {
+		std::shared_ptr<const WavetableData> entry;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = entries.find(hash);
+			if (it != entries.end())
+				entry = it->second.lock();
+		}
+		// Samples shared by addSamples() compare equal without reading them.
+		if (!entry || !entry->hasSameSamples(data))
+			return NULL;
+		return entry;
+	}
+
+	/** Registers bandlimited data and returns it, or returns equal data registered by another Wavetable before. */
+	std::shared_ptr<const WavetableData> add(std::shared_ptr<const WavetableData> data, uint64_t hash) {
+		std::shared_ptr<const WavetableData> entry = find(*data, hash);
+		if (entry)
+			return entry;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		removeExpired();
+		std::weak_ptr<const WavetableData>& registered = entries[hash];
+		// Different samples with the same hash aren't shared.
+		if (registered.expired())
+			registered = data;
+		return data;
+	}
+
+	/** Removes entries of deleted data. Caller must hold `mutex`. */
+	void removeExpired() {
+		for (auto it = samples.begin(); it != samples.end();) {
+			if (it->second.expired())
+				it = samples.erase(it);
+			else
+				it++;
+		}
+		for (auto it = entries.begin(); it != entries.end();) {
+			if (it->second.expired())
+				it = entries.erase(it);
+			else
+				it++;
+		}
+	}
+
+	static WavetableRegistry& get() {
+		static WavetableRegistry registry;
+		return registry;
+	}
+};
+
+
+/** Loads and stores wavetable samples and metadata.
+The audio thread reads the current WavetableData through a Reader.
+Other threads never modify published data, they build a new WavetableData and swap it in with publish().
+New samples are published right away and bandlimited by a worker thread, which publishes them again when done.
+*/
+struct Wavetable {
+	/** Threads that read the data. Each thread may hold only one Reader at a time. */
+	enum ReaderId {
+		AUDIO_READER,
+		UI_READER,
+		SAVE_READER,
+		NUM_READERS
+	};
+
+	/** Name of loaded wavetable. */
+	std::string filename;
+	/** Upsampling factor of new data. No upsampling if 0. */
+	size_t quality = 0;
+	/** Number of points in each wave of new data */
+	size_t waveLen = 0;
+
+	/** Current data, never NULL. May be shared with other Wavetables through the WavetableRegistry. */
+	std::shared_ptr<const WavetableData> current;
+	/** `current` for readers */
+	std::atomic<const WavetableData*> data;
+	/** Data acquired by each reader, which must not be released until the reader is done */
+	mutable std::atomic<const WavetableData*> hazards[NUM_READERS];
+	/** Replaced data which was still acquired by a reader when it was replaced */
+	std::vector<std::shared_ptr<const WavetableData>> retired;
+	/** Held while modifying `retired`, which the worker and UI thread both release */
+	std::mutex retiredMutex;
+	/** Held by threads replacing the data */
+	std::mutex mutex;
+
+	/** Bandlimits the last published samples */
+	std::thread worker;
+	/** Fraction of waves bandlimited by the worker, or 1 if it is not running */
+	std::atomic<float> progress;
+	/** Tells the worker to stop early */
+	std::atomic<bool> cancel;
+
+	/** Writes the data acquired with SAVE_READER to the patch storage directory */
+	std::thread saver;
+	/** Whether this Wavetable is a user of the WavetableThreadPool, from its first bandlimiting until it is destroyed.
+	Wavetables that never bandlimit, like the static defaultWavetable, never start the pool, so a static destructor never stops it.
+	*/
+	bool poolUser = false;
+
+	/** File last written by saveIfModified() or read by load() */
+	std::string savedPath;
+	/** WavetableData::getSamplesHash() of the samples in `savedPath` */
+	uint64_t savedHash = 0;
+
+	/** Holds the current data for the lifetime of the Reader. */
+	struct Reader {
+		const Wavetable& wavetable;
+		ReaderId id;
+		const WavetableData* data;
+
+		Reader(const Wavetable& wavetable, ReaderId id) : wavetable(wavetable), id(id) {
+			data = wavetable.acquire(id);
+		}
+		~Reader() {
+			wavetable.release(id);
+		}
+		const WavetableData* operator->() const {
+			return data;
+		}
+	};
+
+	Wavetable() {
+		progress = 1.f;
+		cancel = false;
+		current = std::make_shared<WavetableData>();
+		data = current.get();
+		for (int i = 0; i < NUM_READERS; i++) {
+			hazards[i] = NULL;
+		}
+	}
+
+	~Wavetable() {
+		stopWorker();
+		joinSaver();
+		if (poolUser)
+			WavetableThreadPool::get().removeUser();
+	}
+
+	/** Returns the current data and keeps it from being deleted until release().
+	Lock-free and wait-free unless the data is replaced while acquiring, so it can be called from the audio thread.
+	*/
+	const WavetableData* acquire(ReaderId id) const {
+		const WavetableData* d = data.load();
+		while (true) {
+			hazards[id].store(d);
+			// If the data was replaced before the hazard was stored, publish() might not have seen the hazard, so try again.
+			const WavetableData* d2 = data.load();
+			if (d2 == d)
+				return d;
+			d = d2;
+		}
+	}
+
+	void release(ReaderId id) const {
+		hazards[id].store(NULL, std::memory_order_release);
+	}
+
+	/** Replaces the current data, and releases replaced data no reader holds.
+	Data is deleted when the last Wavetable sharing it releases it, which is never on the audio thread.
+	Caller must hold `mutex`, or be the worker started by its holder.
+	*/
+	void publish(std::shared_ptr<const WavetableData> newData) {
+		std::lock_guard<std::mutex> lock(retiredMutex);
+		retired.push_back(current);
+		current = newData;
+		data = newData.get();
+		releaseRetiredLocked();
+	}
+
+	/** Releases replaced data that readers held when it was replaced, but no longer hold.
+	Otherwise it would only be released by the next publish(), which may never come.
+	Call periodically from the UI thread.
+	*/
+	void releaseRetired() {
+		std::lock_guard<std::mutex> lock(retiredMutex);
+		releaseRetiredLocked();
+	}
+
+	/** Caller must hold `retiredMutex`. */
+	void releaseRetiredLocked() {
+		retired.erase(std::remove_if(retired.begin(), retired.end(), [&](const std::shared_ptr<const WavetableData>& d) {
+			for (const auto& hazard : hazards) {
+				if (hazard.load() == d.get())
+					return false;
+			}
+			return true;
+		}), retired.end());
+	}
+
+	/** Publishes samples with the current waveLen and quality, and starts the worker to bandlimit them.
+	If another Wavetable already has bandlimited data for the same samples, shares it instead.
+	Until the worker is done, WTVCO plays the samples without bandlimiting.
+	If `async` is false, bandlimits them on this thread before publishing.
+	Returns WavetableData::getSamplesHash() of the samples.
+	Caller must hold `mutex`.
+	*/
+	uint64_t publishSamples(FloatArray&& samples, bool async = true) {
+		stopWorker();
+		std::shared_ptr<WavetableData> newData = std::make_shared<WavetableData>();
+		newData->samples = std::move(samples);
+		newData->waveLen = waveLen;
+		newData->quality = quality;
+		uint64_t samplesHash = newData->getSamplesHash();
+		newData->samplesHash = samplesHash;
+		// Share the samples with Wavetables that loaded the same ones at any quality
+		newData->samples = WavetableRegistry::get().addSamples(newData->samples, samplesHash);
+
+		uint64_t hash = newData->getHash();
+		std::shared_ptr<const WavetableData> sharedData = WavetableRegistry::get().find(*newData, hash);
+		if (sharedData) {
+			publish(sharedData);
+			return samplesHash;
+		}
+
+		if (quality > 0 && !poolUser) {
+			WavetableThreadPool::get().addUser();
+			poolUser = true;
+		}
+
+		if (!async || quality == 0 || newData->getWaveCount() == 0) {
+			newData->interpolate();
+			publish(WavetableRegistry::get().add(newData, hash));
+			return samplesHash;
+		}
+
+		// Shares the samples with newData
+		std::shared_ptr<WavetableData> interpolatedData = std::make_shared<WavetableData>(*newData);
+		publish(newData);
+		progress = 0.f;
+		worker = std::thread([=]() {
+			// saveOctaves() names its temporary file with random::u32(), whose state is per thread.
+			random::init();
+			if (interpolatedData->interpolateCached(hash, &progress, &cancel))
+				publish(WavetableRegistry::get().add(interpolatedData, hash));
+			progress = 1.f;
+		});
+		return samplesHash;
+	}
+
+	/** Cancels the worker and waits for it to finish.
+	Caller must hold `mutex`.
+	*/
+	void stopWorker() {
+		if (!worker.joinable())
+			return;
+		cancel = true;
+		worker.join();
+		cancel = false;
+	}
+
+	/** Returns whether the wavetable has no samples. Call from the UI thread. */
+	bool empty() const {
+		Reader reader(*this, UI_READER);
+		return reader->samples.empty();
+	}
+
+	void reset() {
+		std::lock_guard<std::mutex> lock(mutex);
+		filename = "Basic.wav";
+		waveLen = 1024;
+		std::vector<float> samples(waveLen * 4);
+
+		for (size_t i = 0; i < waveLen; i++) {
+			float p = float(i) / waveLen;
+			// Sine
+			samples[waveLen * 0 + i] = std::sin(2 * float(M_PI) * p);
+			// Triangle
+			samples[waveLen * 1 + i] = (p < 0.25f) ? 4*p : (p < 0.75f) ? 2 - 4*p : 4*p - 4;
+			// Sawtooth
+			samples[waveLen * 2 + i] = (p < 0.5f) ? 2*p : 2*p - 2;
+			// Square
+			samples[waveLen * 3 + i] = (p < 0.5f) ? 1 : -1;
+		}
+		// The basic wavetable is small, so new modules can start with it bandlimited.
+		publishSamples(std::move(samples), false);
+	}
+
+	void setQuality(size_t quality) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (quality == this->quality)
+			return;
+		this->quality = quality;
+		// Once the worker is stopped, only this thread deletes data, so it can be read without a Reader.
+		// The new data shares the samples instead of copying them.
+		stopWorker();
+		publishSamples(FloatArray(current->samples));
+	}
+
+	void setWaveLen(size_t waveLen) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (waveLen == this->waveLen)
+			return;
+		this->waveLen = waveLen;
+		stopWorker();
+		publishSamples(FloatArray(current->samples));
 	}
 
 	json_t* toJson() const {
@@ -162,10 +1179,10 @@ struct Wavetable {
 	}
 
 	void load(std::string path) {
-		loading = true;
-		DEFER({loading = false;});
-		// HACK Sleep 100us so DSP thread is likely to finish processing before we resize the vector
-		std::this_thread::sleep_for(std::chrono::duration<double>(100e-6));
+		std::lock_guard<std::mutex> lock(mutex);
+		joinSaver();
+		FloatArray samples;
+		size_t newWaveLen = waveLen;
 
 		std::string ext = string::lowercase(system::getExtension(path));
 		if (ext == ".wav") {
@@ -177,55 +1194,80 @@ struct Wavetable {
 			if (!drwav_init_file(&wav, path.c_str(), NULL))
 #endif
 				return;
+			DEFER({drwav_uninit(&wav);});
 
-			size_t len = wav.totalPCMFrameCount * wav.channels;
-			if (len == 0 || len >= (1 << 20))
+			uint64_t len = wav.totalPCMFrameCount * wav.channels;
+			if (len == 0 || len > WAVETABLE_MAX_LEN)
 				return;
 
-			samples.clear();
 			samples.resize(len);
 
-			// If sample rate is a power of 2, set waveLen to it.
+			// If sample rate is a power of 2, set waveLen to it once the samples are read.
 			if ((wav.sampleRate & (wav.sampleRate - 1)) == 0)
-				waveLen = wav.sampleRate;
+				newWaveLen = wav.sampleRate;
 
-			drwav_read_pcm_frames_f32(&wav, wav.totalPCMFrameCount, samples.data());
-			drwav_uninit(&wav);
+			// Read straight into the samples, one chunk at a time so dr_wav converts through its own small buffer.
+			size_t frames = 0;
+			size_t chunkFrames = std::max(WAVETABLE_LOAD_CHUNK / wav.channels, (size_t) 1);
+			while (frames < wav.totalPCMFrameCount) {
+				size_t n = drwav_read_pcm_frames_f32(&wav, std::min(wav.totalPCMFrameCount - frames, (drwav_uint64) chunkFrames), samples.data() + frames * wav.channels);
+				if (n == 0)
+					break;
+				frames += n;
+			}
+			// Keep what could be read of truncated files
+			samples.resize(frames * wav.channels);
+			if (samples.empty())
+				return;
 		}
 		else {
-			// Load bytes from file
-			std::vector<uint8_t> data = system::readFile(path);
-			samples.clear();
-
-			if (ext == ".f32") {
-				size_t len = data.size() / sizeof(float);
-				samples.resize(len);
-				// This is the same as memcpy but consistent with the other conversions.
-				dsp::convert((const float*) data.data(), samples.data(), len);
-			}
-			else if (ext == ".s8" || ext == ".i8") {
-				size_t len = data.size() / sizeof(int8_t);
-				samples.resize(len);
-				dsp::convert((const int8_t*) data.data(), samples.data(), len);
-			}
-			else if (ext == ".s16" || ext == ".i16") {
-				size_t len = data.size() / sizeof(int16_t);
-				samples.resize(len);
-				dsp::convert((const int16_t*) data.data(), samples.data(), len);
-			}
-			else if (ext == ".s24" || ext == ".i24") {
-				size_t len = data.size() / sizeof(dsp::Int24);
-				samples.resize(len);
-				dsp::convert((const dsp::Int24*) data.data(), samples.data(), len);
-			}
-			else if (ext == ".s32" || ext == ".i32" || true) {
-				size_t len = data.size() / sizeof(int32_t);
-				samples.resize(len);
-				dsp::convert((const int32_t*) data.data(), samples.data(), len);
-			}
+			bool loaded;
+			// Raw files are copied rather than mapped, so changing or truncating the file after loading doesn't affect the samples.
+			if (ext == ".f32")
+				loaded = loadRaw<float>(path, samples);
+			else if (ext == ".s8" || ext == ".i8")
+				loaded = loadRaw<int8_t>(path, samples);
+			else if (ext == ".s16" || ext == ".i16")
+				loaded = loadRaw<int16_t>(path, samples);
+			else if (ext == ".s24" || ext == ".i24")
+				loaded = loadRaw<dsp::Int24>(path, samples);
+			else
+				loaded = loadRaw<int32_t>(path, samples);
+			if (!loaded)
+				return;
 		}
 
-		interpolate();
+		waveLen = newWaveLen;
+		savedPath = path;
+		savedHash = publishSamples(std::move(samples));
+	}
+
+	/** Reads a headerless file of `T` samples a chunk at a time, so the file's bytes and the samples are never in memory at once.
+	Returns false if the file can't be read, is empty, or has more than WAVETABLE_MAX_LEN samples.
+	*/
+	template <typename T>
+	static bool loadRaw(const std::string& path, FloatArray& samples) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		DEFER({fclose(file);});
+
+		size_t len = system::getFileSize(path) / sizeof(T);
+		if (len == 0 || len > WAVETABLE_MAX_LEN)
+			return false;
+		samples.resize(len);
+
+		T chunk[WAVETABLE_LOAD_CHUNK];
+		size_t pos = 0;
+		while (pos < len) {
+			size_t n = fread(chunk, sizeof(T), std::min(len - pos, WAVETABLE_LOAD_CHUNK), file);
+			if (n == 0)
+				break;
+			dsp::convert(chunk, samples.data() + pos, n);
+			pos += n;
+		}
+		samples.resize(pos);
+		return pos > 0;
 	}
 
 	void loadDialog() {
@@ -245,27 +1287,81 @@ struct Wavetable {
 		filename = system::getFilename(path);
 	}
 
-	void save(std::string path) const {
+	/** Writes the samples to a 32-bit float WAV file, so loading it gives back the same samples.
+	Returns false if there are no samples or the file can't be written.
+	*/
+	bool save(std::string path) const {
+		Reader reader(*this, UI_READER);
+		return save(path, *reader.data);
+	}
+
+	/** Writes to a temporary file and renames it, so `path` never holds a partly written file. */
+	static bool save(std::string path, const WavetableData& data) {
+		const FloatArray& samples = data.samples;
 		if (samples.size() == 0)
-			return;
+			return false;
 
 		drwav_data_format format;
 		format.container = drwav_container_riff;
-		format.format = DR_WAVE_FORMAT_PCM;
+		format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
 		format.channels = 1;
-		format.sampleRate = waveLen;
-		format.bitsPerSample = 16;
+		format.sampleRate = data.waveLen;
+		format.bitsPerSample = 32;
 
+		std::string tmpPath = path + string::f(".%08x.tmp", random::u32());
 		drwav wav;
-		if (!drwav_init_file_write(&wav, path.c_str(), &format, NULL))
+#if defined ARCH_WIN
+		if (!drwav_init_file_write_w(&wav, string::UTF8toUTF16(tmpPath).c_str(), &format, NULL))
+#else
+		if (!drwav_init_file_write(&wav, tmpPath.c_str(), &format, NULL))
+#endif
+			return false;
+		bool written = (drwav_write_pcm_frames(&wav, samples.size(), samples.data()) == samples.size());
+		written = (drwav_uninit(&wav) == DRWAV_SUCCESS) && written;
+		if (!written || !system::rename(tmpPath, path)) {
+			system::remove(tmpPath);
+			return false;
+		}
+		return true;
+	}
+
+	/** Saves to `path` on the saver thread, unless it already holds the current samples, as after loading it or saving to it before.
+	Modules call this on every patch save, so it returns without waiting for the file to be written.
+	Call from the UI thread.
+	*/
+	void saveIfModified(std::string path) {
+		std::lock_guard<std::mutex> lock(mutex);
+		joinSaver();
+		releaseRetired();
+		// Published data is never modified, so holding it is enough for a snapshot.
+		const WavetableData* d = acquire(SAVE_READER);
+		if (path == savedPath && d->samplesHash == savedHash && system::exists(path)) {
+			release(SAVE_READER);
 			return;
+		}
+		saver = std::thread([=]() {
+			// save() names its temporary file with random::u32(), whose state is per thread.
+			random::init();
+			if (save(path, *d)) {
+				savedPath = path;
+				savedHash = d->samplesHash;
+			}
+			release(SAVE_READER);
+		});
+	}
 
-		int16_t* buf = new int16_t[samples.size()];
-		drwav_f32_to_s16(buf, samples.data(), samples.size());
-		drwav_write_pcm_frames(&wav, samples.size(), buf);
-		delete[] buf;
+	/** Waits for the file written by saveIfModified().
+	Modules call this before Rack archives the patch storage directory.
+	*/
+	void waitForSave() {
+		std::lock_guard<std::mutex> lock(mutex);
+		joinSaver();
+	}
 
-		drwav_uninit(&wav);
+	/** Caller must hold `mutex`. */
+	void joinSaver() {
+		if (saver.joinable())
+			saver.join();
 	}
 
 	void saveDialog() const {
@@ -309,7 +1405,7 @@ struct Wavetable {
 		}
 		menu->addChild(createIndexSubmenuItem("Wave points", sizeLabels,
 			[=]() {return math::log2(waveLen) - sizeOffset;},
-			[=](int i) {waveLen = 1 << (i + sizeOffset);}
+			[=](int i) {setWaveLen(1 << (i + sizeOffset));}
 		));
 	}
 };
@@ -322,16 +1418,63 @@ template <class TModule>
 struct WTDisplay : LedDisplay {
 	TModule* module;
 
+	/** Scope line in [0, 1]^2, rebuilt only when the wave changes or the position moves it visibly */
+	std::vector<Vec> points;
+	/** WavetableData::samplesHash of the wave in `points` */
+	uint64_t pointsHash = 0;
+	size_t pointsPos0 = 0;
+	float pointsPosF = 0.f;
+	/** Largest difference between the two crossfaded waves in `points` */
+	float pointsMaxDiff = 0.f;
+
+	void updatePoints(const WavetableData& data, size_t pos0, float posF) {
+		points.clear();
+		pointsHash = data.samplesHash;
+		pointsPos0 = pos0;
+		pointsPosF = posF;
+		pointsMaxDiff = 0.f;
+		size_t iSkip = data.waveLen / 128 + 1;
+
+		for (size_t i = 0; i <= data.waveLen; i += iSkip) {
+			// Get wave value
+			float wave;
+			float wave0 = data.at(pos0, i % data.waveLen);
+			if (pos0 + 1 < data.getWaveCount()) {
+				float wave1 = data.at(pos0 + 1, i % data.waveLen);
+				wave = crossfade(wave0, wave1, posF);
+				pointsMaxDiff = std::max(pointsMaxDiff, std::fabs(wave1 - wave0));
+			}
+			else {
+				wave = wave0;
+			}
+
+			// Add point to line
+			Vec p;
+			p.x = float(i) / data.waveLen;
+			p.y = 0.5f - 0.5f * wave;
+			points.push_back(p);
+		}
+	}
+
+	void step() override {
+		// Data replaced while the audio thread held it is released here once the audio thread is done with it.
+		if (module)
+			module->wavetable.releaseRetired();
+		LedDisplay::step();
+	}
+
 	void drawLayer(const DrawArgs& args, int layer) override {
 		nvgScissor(args.vg, RECT_ARGS(args.clipBox));
 
 		if (layer == 1) {
-			if (defaultWavetable.samples.empty())
+			if (defaultWavetable.empty())
 				defaultWavetable.reset();
 
 			// Get module data or defaults
 			const Wavetable& wavetable = module ? module->wavetable : defaultWavetable;
 			float lastPos = module ? module->lastPos : 0.f;
+			Wavetable::Reader reader(wavetable, Wavetable::UI_READER);
+			const WavetableData& data = *reader.data;
 
 			// Draw filename text
 			std::string fontPath = asset::system("res/fonts/ShareTechMono-Regular.ttf");
@@ -343,11 +1486,20 @@ struct WTDisplay : LedDisplay {
 			nvgFillColor(args.vg, SCHEME_YELLOW);
 			nvgText(args.vg, 4.0, 13.0, wavetable.filename.c_str(), NULL);
 
+			// Draw progress bar while the worker bandlimits the wavetable
+			float progress = wavetable.progress;
+			if (progress < 1.f) {
+				nvgBeginPath(args.vg);
+				nvgRect(args.vg, 0.0, box.size.y - 2.0, box.size.x * progress, 2.0);
+				nvgFillColor(args.vg, SCHEME_YELLOW);
+				nvgFill(args.vg);
+			}
+
 			// Get wavetable metadata
-			if (wavetable.waveLen < 2)
+			if (data.waveLen < 2)
 				return;
 
-			size_t waveCount = wavetable.getWaveCount();
+			size_t waveCount = data.getWaveCount();
 			if (waveCount < 1)
 				return;
 			if (lastPos > waveCount - 1)
@@ -361,25 +1513,14 @@ struct WTDisplay : LedDisplay {
 			Vec scopePos = Vec(0.0, 13.0);
 			Rect scopeRect = Rect(scopePos, box.size - scopePos);
 			scopeRect = scopeRect.shrink(Vec(4, 5));
-			size_t iSkip = wavetable.waveLen / 128 + 1;
-
-			for (size_t i = 0; i <= wavetable.waveLen; i += iSkip) {
-				// Get wave value
-				float wave;
-				float wave0 = wavetable.at(pos0, i % wavetable.waveLen);
-				if (posF > 0.f) {
-					float wave1 = wavetable.at(pos0 + 1, i % wavetable.waveLen);
-					wave = crossfade(wave0, wave1, posF);
-				}
-				else {
-					wave = wave0;
-				}
 
-				// Add point to line
-				Vec p;
-				p.x = float(i) / wavetable.waveLen;
-				p.y = 0.5f - 0.5f * wave;
-				p = scopeRect.pos + scopeRect.size * p;
+			// Changing posF moves each point by at most this many pixels
+			float posMove = std::fabs(posF - pointsPosF) * pointsMaxDiff * 0.5f * scopeRect.size.y;
+			if (points.empty() || data.samplesHash != pointsHash || pos0 != pointsPos0 || posMove > 1.f)
+				updatePoints(data, pos0, posF);
+
+			for (size_t i = 0; i < points.size(); i++) {
+				Vec p = scopeRect.pos + scopeRect.size * points[i];
 				if (i == 0)
 					nvgMoveTo(args.vg, VEC_ARGS(p));
 				else
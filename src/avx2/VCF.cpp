@@ -0,0 +1,8 @@
+#include "../plugin.hpp"
+#include "float_8.hpp"
+#include "../LadderFilter.hpp"
+
+
+LadderFilterBank* createLadderFilterBankAvx2() {
+	return new TLadderFilterBank<simd::float_8>;
+}
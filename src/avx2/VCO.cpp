@@ -0,0 +1,8 @@
+#include "../plugin.hpp"
+#include "float_8.hpp"
+#include "../VoltageControlledOscillator.hpp"
+
+
+OscillatorBank* createOscillatorBankAvx2(int quality, int oversampling) {
+	return newOscillatorBank<simd::float_8>(quality, oversampling);
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include <rack.hpp>
+#include <immintrin.h>
+
+#if !defined __AVX2__ || !defined __FMA__
+	#error "float_8.hpp must be compiled with -mavx2 -mfma"
+#endif
+
+
+namespace rack {
+namespace simd {
+
+
+/** Wrapper for `__m256` vector with the same interface as float_4, for code templated on the vector type.
+Only include this in translation units compiled with AVX2 enabled.
+*/
+template <>
+struct Vector<float, 8> {
+	using type = float;
+	constexpr static int size = 8;
+
+	union {
+		__m256 v;
+		float s[8];
+	};
+
+	Vector() = default;
+
+	Vector(__m256 v) : v(v) {}
+
+	Vector(float x) {
+		v = _mm256_set1_ps(x);
+	}
+
+	Vector(float x0, float x1, float x2, float x3, float x4, float x5, float x6, float x7) {
+		v = _mm256_setr_ps(x0, x1, x2, x3, x4, x5, x6, x7);
+	}
+
+	static Vector zero() {
+		return Vector(_mm256_setzero_ps());
+	}
+
+	static Vector mask() {
+		return Vector(_mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+	}
+
+	static Vector load(const float* x) {
+		return Vector(_mm256_loadu_ps(x));
+	}
+
+	void store(float* x) {
+		_mm256_storeu_ps(x, v);
+	}
+
+	float& operator[](int i) {
+		return s[i];
+	}
+	const float& operator[](int i) const {
+		return s[i];
+	}
+};
+
+
+typedef Vector<float, 8> float_8;
+
+
+#define DECLARE_FLOAT_8_OPERATOR(op, f) \
+	inline float_8 operator op(const float_8& a, const float_8& b) { \
+		return float_8(f(a.v, b.v)); \
+	} \
+	inline float_8 operator op(const float_8& a, float b) { \
+		return a op float_8(b); \
+	} \
+	inline float_8 operator op(float a, const float_8& b) { \
+		return float_8(a) op b; \
+	} \
+	inline float_8& operator op##=(float_8& a, const float_8& b) { \
+		return a = a op b; \
+	} \
+	inline float_8& operator op##=(float_8& a, float b) { \
+		return a = a op float_8(b); \
+	}
+
+DECLARE_FLOAT_8_OPERATOR(+, _mm256_add_ps)
+DECLARE_FLOAT_8_OPERATOR(-, _mm256_sub_ps)
+DECLARE_FLOAT_8_OPERATOR(*, _mm256_mul_ps)
+DECLARE_FLOAT_8_OPERATOR(/, _mm256_div_ps)
+DECLARE_FLOAT_8_OPERATOR(&, _mm256_and_ps)
+DECLARE_FLOAT_8_OPERATOR(|, _mm256_or_ps)
+DECLARE_FLOAT_8_OPERATOR(^, _mm256_xor_ps)
+
+#undef DECLARE_FLOAT_8_OPERATOR
+
+
+#define DECLARE_FLOAT_8_COMPARISON(op, predicate) \
+	inline float_8 operator op(const float_8& a, const float_8& b) { \
+		return float_8(_mm256_cmp_ps(a.v, b.v, predicate)); \
+	} \
+	inline float_8 operator op(const float_8& a, float b) { \
+		return a op float_8(b); \
+	} \
+	inline float_8 operator op(float a, const float_8& b) { \
+		return float_8(a) op b; \
+	}
+
+// Ordered comparisons, except for != which is true for NAN like float_4
+DECLARE_FLOAT_8_COMPARISON(==, _CMP_EQ_OQ)
+DECLARE_FLOAT_8_COMPARISON(!=, _CMP_NEQ_UQ)
+DECLARE_FLOAT_8_COMPARISON(<, _CMP_LT_OQ)
+DECLARE_FLOAT_8_COMPARISON(<=, _CMP_LE_OQ)
+DECLARE_FLOAT_8_COMPARISON(>, _CMP_GT_OQ)
+DECLARE_FLOAT_8_COMPARISON(>=, _CMP_GE_OQ)
+
+#undef DECLARE_FLOAT_8_COMPARISON
+
+
+inline float_8 operator+(const float_8& a) {
+	return a;
+}
+
+inline float_8 operator-(const float_8& a) {
+	return 0.f - a;
+}
+
+inline float_8 operator~(const float_8& a) {
+	return a ^ float_8::mask();
+}
+
+
+inline float_8 ifelse(float_8 mask, float_8 a, float_8 b) {
+	return float_8(_mm256_blendv_ps(b.v, a.v, mask.v));
+}
+
+inline int movemask(float_8 a) {
+	return _mm256_movemask_ps(a.v);
+}
+
+template <>
+inline float_8 movemaskInverse<float_8>(int x) {
+	__m256i bits = _mm256_setr_epi32(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+	__m256i t = _mm256_and_si256(_mm256_set1_epi32(x), bits);
+	return float_8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, bits)));
+}
+
+inline float_8 fmin(float_8 a, float_8 b) {
+	return float_8(_mm256_min_ps(a.v, b.v));
+}
+
+inline float_8 fmax(float_8 a, float_8 b) {
+	return float_8(_mm256_max_ps(a.v, b.v));
+}
+
+inline float_8 clamp(float_8 x, float_8 a = 0.f, float_8 b = 1.f) {
+	return fmin(fmax(x, a), b);
+}
+
+inline float_8 fabs(float_8 a) {
+	return a & float_8(_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+}
+
+inline float_8 floor(float_8 a) {
+	return float_8(_mm256_floor_ps(a.v));
+}
+
+inline float_8 trunc(float_8 a) {
+	return float_8(_mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+}
+
+inline float_8 round(float_8 a) {
+	return float_8(_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+inline float_8 sqrt(float_8 a) {
+	return float_8(_mm256_sqrt_ps(a.v));
+}
+
+inline float_8 pow(float_8 a, int b) {
+	// Exponentiation by squaring, unrolled when `b` is known at compile time
+	float_8 p = 1.f;
+	for (int i = 1; i <= b; i <<= 1) {
+		if (b & i)
+			p *= a;
+		a *= a;
+	}
+	return p;
+}
+
+inline float_8 crossfade(float_8 a, float_8 b, float_8 p) {
+	return a + (b - a) * p;
+}
+
+
+/** Transposes an 8x8 matrix stored as 8 rows. */
+inline void transpose(float_8 (&x)[8]) {
+	__m256 t0 = _mm256_unpacklo_ps(x[0].v, x[1].v);
+	__m256 t1 = _mm256_unpackhi_ps(x[0].v, x[1].v);
+	__m256 t2 = _mm256_unpacklo_ps(x[2].v, x[3].v);
+	__m256 t3 = _mm256_unpackhi_ps(x[2].v, x[3].v);
+	__m256 t4 = _mm256_unpacklo_ps(x[4].v, x[5].v);
+	__m256 t5 = _mm256_unpackhi_ps(x[4].v, x[5].v);
+	__m256 t6 = _mm256_unpacklo_ps(x[6].v, x[7].v);
+	__m256 t7 = _mm256_unpackhi_ps(x[6].v, x[7].v);
+	__m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+	x[0].v = _mm256_permute2f128_ps(u0, u4, 0x20);
+	x[1].v = _mm256_permute2f128_ps(u1, u5, 0x20);
+	x[2].v = _mm256_permute2f128_ps(u2, u6, 0x20);
+	x[3].v = _mm256_permute2f128_ps(u3, u7, 0x20);
+	x[4].v = _mm256_permute2f128_ps(u0, u4, 0x31);
+	x[5].v = _mm256_permute2f128_ps(u1, u5, 0x31);
+	x[6].v = _mm256_permute2f128_ps(u2, u6, 0x31);
+	x[7].v = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+
+} // namespace simd
+} // namespace rack
@@ -83,4 +83,14 @@ MenuItem* createRangeItem(std::string label, float* gain, float* offset) {
 			*offset = ranges[i].offset;
 		}
 	);
-}
\ No newline at end of file
+}
+
+
+bool hasAvx2() {
+#if defined AVX2_CORES
+	static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return supported;
+#else
+	return false;
+#endif
+}
@@ -141,3 +141,6 @@ struct VCVBezelLightBig : TBase {
 
 
 MenuItem* createRangeItem(std::string label, float* gain, float* offset);
+
+/** Returns whether the src/avx2 variants of DSP cores are built and the CPU supports their AVX2 and FMA instructions. */
+bool hasAvx2();